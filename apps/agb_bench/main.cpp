@@ -0,0 +1,547 @@
+// apps/agb_bench   Headless frame-pipeline benchmark
+//
+// Renders a scene for thousands of frames and reports per-stage timings
+// (p50/p99/max, mean) plus frames per second, as a table and optionally JSON.
+// Stages, in frame order:
+//   snapshot  gba::snapshot_to (HAL scene only)
+//   sync      agb_sync_to_backend(_delta)
+//   submit    record + submit (Vulkan); the whole synchronous render otherwise
+//   wait      host wait for the frame's fence (Vulkan)
+//   gpu       device time from timestamp queries (Vulkan, when supported)
+//   readback  framebuffer copy to host memory (in-place acquire with --acquire),
+//             plus the upscaled copy with --upscale
+//   present   agb_present_to_backend: all of the above, or a skip (--frame-skip)
+//   frame     the whole iteration
+// Only compute queues are used, so it runs without a display; for lavapipe
+// point VK_DRIVER_FILES (VK_ICD_FILENAMES on older loaders) at lvp_icd.*.json.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "agb_bridge.h"
+#include "agb_renderer.h"
+#include "agb_scene.h"
+#include "agb_vk.h"
+#include "gba_port.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t FB_W = 240;
+constexpr uint32_t FB_H = 160;
+constexpr uint32_t MAP_W = 32;
+constexpr uint32_t MAP_H = 32;
+constexpr uint32_t OBJ_CHAR_BASE = 32 * 1024;
+constexpr uint32_t OBJ_MAP_MODE = 0;
+
+enum Stage { ST_SNAPSHOT, ST_SYNC, ST_SUBMIT, ST_WAIT, ST_GPU, ST_READBACK, ST_PRESENT, ST_FRAME, STAGE_COUNT };
+const char* const STAGE_NAMES[STAGE_COUNT] = { "snapshot", "sync", "submit", "wait", "gpu", "readback", "present", "frame" };
+
+struct Options {
+    std::string scene = "hal";      // hal | demo | stress | capture:<file>
+    std::string backend = "auto";   // auto | vulkan | cpu | null
+    std::string jsonPath;           // empty = none, "-" = stdout
+    uint32_t frames = 5000;
+    uint32_t warmup = 60;
+    uint32_t seed = 1;              // stress scene
+    bool fullSync = false;          // agb_sync_to_backend instead of the delta path
+    bool frameSkip = false;         // agb_present_to_backend (skips unchanged frames)
+    bool zeroCopy = false;          // HAL scene: snapshot straight into the backend's state
+    bool acquire = false;           // read frames in place (agb_renderer_acquire_frame), no copy
+    std::string output = "rgba8";   // Vulkan output pass format (agbvk_set_output)
+    bool half = false;              // Vulkan output pass 2x downscale
+    bool frameInfo = false;         // Vulkan frame hash + change box (agbvk_frame_info)
+    std::string upscale = "none";   // Vulkan upscale stage (agbvk_set_upscale)
+    bool animate = true;
+};
+
+void usage() {
+    std::cout <<
+        "usage: agb_bench [options]\n"
+        "  --scene hal|demo|stress|capture:<file>  scene to render (default hal)\n"
+        "        hal      synthetic tiles/sprites written to the HAL, snapshotted each frame\n"
+        "        demo     agb_init_hw's demo scene, scrolled each frame\n"
+        "        stress   agb_scene_worst_case: every feature at its heaviest, animated\n"
+        "        capture  raw AgbHwState records (" << sizeof(AgbHwState) << " bytes each) back to back, replayed in a loop\n"
+        "  --backend auto|vulkan|cpu|null  renderer (default auto, see $" AGB_RENDERER_ENV ")\n"
+        "  --frames N        measured frames (default 5000)\n"
+        "  --warmup N        unmeasured frames first (default 60)\n"
+        "  --seed N          stress scene seed (default 1)\n"
+        "  --full-sync       upload the whole state every frame\n"
+        "  --frame-skip      present through agb_present_to_backend, reusing unchanged frames\n"
+        "  --zero-copy       hal scene: snapshot into agb_renderer_map_state, no sync\n"
+        "  --acquire         read frames in place with agb_renderer_acquire_frame, no copy\n"
+        "  --output FORMAT   vulkan: reduced readback, rgba8|gray8|rgb565|bgr555 (default rgba8)\n"
+        "  --half            vulkan: 2x box-downscaled readback\n"
+        "  --frame-info      vulkan: GPU frame hash and changed-pixel box per frame\n"
+        "  --upscale MODE    vulkan: also read an upscaled frame, nearest2|nearest3|nearest4|scale2x\n"
+        "  --static          do not animate synthetic scenes\n"
+        "  --json PATH       write results as JSON (- = stdout)\n";
+}
+
+// Bad command-line values; main prints the usage after the message.
+struct UsageError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Decimal digits only: std::stoul alone would accept "-1" (wrapping it to a
+// huge count), leading blanks and trailing junk.
+uint32_t parse_count(const std::string& v, const char* what) {
+    const bool digits = !v.empty() && std::all_of(v.begin(), v.end(), [](char ch) { return ch >= '0' && ch <= '9'; });
+    if (digits) {
+        try {
+            const unsigned long long n = std::stoull(v);
+            if (n <= 0xFFFFFFFFull) return uint32_t(n);
+        } catch (const std::out_of_range&) {}
+    }
+    throw UsageError(std::string("bad ") + what + ": " + v + " (expected 0.." + std::to_string(0xFFFFFFFFu) + ")");
+}
+
+Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error(a + " needs a value");
+            return argv[++i];
+        };
+        if (a == "--scene") o.scene = value();
+        else if (a == "--backend") o.backend = value();
+        else if (a == "--frames") o.frames = parse_count(value(), "--frames");
+        else if (a == "--warmup") o.warmup = parse_count(value(), "--warmup");
+        else if (a == "--seed") o.seed = parse_count(value(), "--seed");
+        else if (a == "--json") o.jsonPath = value();
+        else if (a == "--full-sync") o.fullSync = true;
+        else if (a == "--frame-skip") o.frameSkip = true;
+        else if (a == "--zero-copy") o.zeroCopy = true;
+        else if (a == "--acquire") o.acquire = true;
+        else if (a == "--output") o.output = value();
+        else if (a == "--half") o.half = true;
+        else if (a == "--frame-info") o.frameInfo = true;
+        else if (a == "--upscale") o.upscale = value();
+        else if (a == "--static") o.animate = false;
+        else if (a == "-h" || a == "--help") { usage(); std::exit(0); }
+        else throw std::runtime_error("unknown option " + a);
+    }
+    if (o.frames == 0) throw std::runtime_error("--frames must be positive");
+    if (o.zeroCopy && (o.scene != "hal" || o.frameSkip))
+        throw std::runtime_error("--zero-copy needs --scene hal and no --frame-skip");
+    if (o.acquire && o.frameSkip)
+        throw std::runtime_error("--acquire and --frame-skip cannot be combined");
+    if ((o.output != "rgba8" || o.half) && (o.acquire || o.frameSkip))
+        throw std::runtime_error("--output/--half cannot be combined with --acquire or --frame-skip");
+    if (o.frameInfo && o.frameSkip)
+        throw std::runtime_error("--frame-info and --frame-skip cannot be combined");
+    if (o.upscale != "none" && o.frameSkip)
+        throw std::runtime_error("--upscale and --frame-skip cannot be combined");
+    return o;
+}
+
+AgbRendererKind backend_kind(const std::string& b) {
+    if (b == "auto") return AGB_RENDERER_AUTO;
+    if (b == "vulkan") return AGB_RENDERER_VULKAN;
+    if (b == "cpu") return AGB_RENDERER_CPU;
+    if (b == "null") return AGB_RENDERER_NULL;
+    throw std::runtime_error("unknown backend " + b);
+}
+
+AgbVkOutputFormat output_format(const std::string& f) {
+    if (f == "rgba8") return AGBVK_OUTPUT_RGBA8;
+    if (f == "gray8") return AGBVK_OUTPUT_GRAY8;
+    if (f == "rgb565") return AGBVK_OUTPUT_RGB565;
+    if (f == "bgr555") return AGBVK_OUTPUT_BGR555;
+    throw std::runtime_error("unknown output format " + f);
+}
+
+AgbVkUpscale upscale_mode(const std::string& m) {
+    if (m == "none") return AGBVK_UPSCALE_NONE;
+    if (m == "nearest2") return AGBVK_UPSCALE_NEAREST_2X;
+    if (m == "nearest3") return AGBVK_UPSCALE_NEAREST_3X;
+    if (m == "nearest4") return AGBVK_UPSCALE_NEAREST_4X;
+    if (m == "scale2x") return AGBVK_UPSCALE_SCALE2X;
+    throw std::runtime_error("unknown upscale mode " + m);
+}
+
+void put16(uint8_t* p, uint16_t v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); }
+
+// ---- Scenes --------------------------------------------------------------
+// HAL scene: two scrolling text BGs of 4bpp tiles and 64 bouncing 16x16 OBJs,
+// written through the HAL mirrors like game code would.
+void hal_scene_init() {
+    gba::VRAM.fill(0);
+    gba::PAL_BG.fill(0);
+    gba::PAL_OBJ.fill(0);
+    gba::OAM.fill(0);
+    gba::REG = gba::Regs{};
+
+    // 16 BG palettes of 16 colors, one shared OBJ ramp
+    for (uint32_t i = 0; i < 256; ++i)
+        put16(&gba::PAL_BG[i * 2], uint16_t(((i * 3) & 31) | (((i * 5) & 31) << 5) | (((i * 7) & 31) << 10)));
+    for (uint32_t i = 1; i < 256; ++i)
+        put16(&gba::PAL_OBJ[i * 2], uint16_t((31 - (i & 31)) | ((i & 31) << 10)));
+
+    // 64 BG tiles in char block 0, OBJ tiles at OBJ_CHAR_BASE
+    for (uint32_t t = 0; t < 64; ++t)
+        for (uint32_t b = 0; b < 32; ++b)
+            gba::VRAM[t * 32 + b] = uint8_t(((t + b) & 15) | (((t * 7 + b * 3) & 15) << 4));
+    for (uint32_t b = 0; b < 32 * 32; ++b)
+        gba::VRAM[OBJ_CHAR_BASE + b] = uint8_t((1 + (b & 7)) | ((1 + ((b >> 3) & 7)) << 4));
+
+    // BG0 map at screen block 28, BG1 at 30
+    for (uint32_t sb : { 28u, 30u })
+        for (uint32_t e = 0; e < 32 * 32; ++e)
+            put16(&gba::VRAM[sb * 2048 + e * 2], uint16_t(((e * sb) & 63) | ((e & 15) << 12)));
+    gba::REG.BG_CNT[0] = uint16_t(0 | (28 << 8));
+    gba::REG.BG_CNT[1] = uint16_t(1 | (30 << 8));
+    gba::REG.BLDCNT = 0x0241;   // BG0 over BG1, alpha
+    gba::REG.BLDALPHA = 0x0808;
+
+    for (uint32_t i = 0; i < 64; ++i) {
+        uint8_t* o = &gba::OAM[i * 8];
+        put16(o + 0, uint16_t((i * 37) & 0x7F));                  // y, square
+        put16(o + 2, uint16_t(((i * 53) & 0xFF) | (1u << 14)));   // x, 16x16
+        put16(o + 4, uint16_t((i & 3) * 4));
+    }
+    for (uint32_t i = 64; i < 128; ++i) put16(&gba::OAM[i * 8], 0x0200);   // hidden
+}
+
+void hal_scene_step(uint32_t frame) {
+    gba::REG.BG_HOFS[0] = uint16_t(frame);
+    gba::REG.BG_VOFS[1] = uint16_t(frame / 2);
+    for (uint32_t i = 0; i < 64; ++i) {
+        uint8_t* o = &gba::OAM[i * 8];
+        put16(o + 0, uint16_t((i * 37 + frame) % 160));
+        put16(o + 2, uint16_t(((i * 53 + frame * (1 + (i & 1))) % 240) | (1u << 14)));
+    }
+}
+
+void demo_scene_step(AgbHwState& hw, const AgbHwState& base, uint32_t frame) {
+    for (uint32_t b = 0; b < AGB_BG_COUNT; ++b) {
+        hw.bg_params[b].hofs = base.bg_params[b].hofs + frame * (b + 1);
+        hw.bg_params[b].vofs = base.bg_params[b].vofs + frame / 2;
+    }
+    for (uint32_t i = 0; i < AGB_OAM_SIZE / 8; ++i) {
+        const uint16_t x = uint16_t(base.oam[i * 8 + 2] | (base.oam[i * 8 + 3] << 8));
+        put16(&hw.oam[i * 8 + 2], uint16_t((x & 0xFE00) | (((x & 0x1FF) + frame) & 0x1FF)));
+    }
+}
+
+std::vector<AgbHwState> load_capture(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f) throw std::runtime_error("cannot open capture " + path);
+    const std::streamsize bytes = f.tellg();
+    if (bytes <= 0 || bytes % std::streamsize(sizeof(AgbHwState)) != 0)
+        throw std::runtime_error(path + " is not a whole number of AgbHwState records");
+    std::vector<AgbHwState> states(size_t(bytes) / sizeof(AgbHwState));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(states.data()), bytes);
+    if (!f) throw std::runtime_error("cannot read capture " + path);
+    return states;
+}
+
+// ---- Statistics ----------------------------------------------------------
+struct Summary { size_t samples; double p50, p99, max, mean; };   // microseconds
+
+Summary summarize(std::vector<uint64_t> ns) {
+    Summary s{ ns.size(), 0, 0, 0, 0 };
+    if (ns.empty()) return s;
+    std::sort(ns.begin(), ns.end());
+    auto rank = [&](double p) {   // nearest-rank percentile
+        const size_t i = size_t(std::ceil(p * double(ns.size())));
+        return double(ns[i ? i - 1 : 0]) / 1000.0;
+    };
+    double sum = 0;
+    for (uint64_t v : ns) sum += double(v);
+    s.p50 = rank(0.50);
+    s.p99 = rank(0.99);
+    s.max = double(ns.back()) / 1000.0;
+    s.mean = sum / double(ns.size()) / 1000.0;
+    return s;
+}
+
+uint64_t since_ns(Clock::time_point t0) {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+}
+
+std::string json_escape(const std::string& s) {
+    std::string r;
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') { r += '\\'; r += ch; }
+        else if (uint8_t(ch) < 0x20) { char buf[8]; std::snprintf(buf, sizeof(buf), "\\u%04x", ch); r += buf; }
+        else r += ch;
+    }
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv) try
+{
+    const Options opt = parse_args(argc, argv);
+
+    //--- Scene ---------------------------------------------------------------------
+    std::unique_ptr<AgbHwState> hw(new AgbHwState{});
+    std::unique_ptr<AgbHwState> base(new AgbHwState{});
+    std::vector<AgbHwState> capture;
+    AgbSceneParams stress{};
+    const bool halScene = opt.scene == "hal";
+    const bool stressScene = opt.scene == "stress";
+    if (halScene) {
+        hal_scene_init();
+    } else if (stressScene) {
+        agb_scene_worst_case(&stress, opt.seed);
+        agb_scene_generate(hw.get(), &stress);
+    } else if (opt.scene == "demo") {
+        agb_init_hw(base.get());
+        *hw = *base;
+    } else if (opt.scene.rfind("capture:", 0) == 0) {
+        capture = load_capture(opt.scene.substr(8));
+    } else {
+        throw std::runtime_error("unknown scene " + opt.scene);
+    }
+
+    //--- Renderer ------------------------------------------------------------------
+    AgbRenderer* r = agb_renderer_create(backend_kind(opt.backend));
+    if (!r) throw std::runtime_error("renderer '" + opt.backend + "' unavailable");
+    AgbVkCtx* vk = agb_renderer_vk(r);   // pipelined submit + GPU timestamps
+    if (opt.zeroCopy && !agb_renderer_ops(r)->map_state)
+        throw std::runtime_error(std::string("renderer '") + agb_renderer_name(r) + "' has no mapped state");
+    if (opt.acquire && !agb_renderer_ops(r)->acquire_frame)
+        throw std::runtime_error(std::string("renderer '") + agb_renderer_name(r) + "' has no in-place frames");
+    const bool reduced = opt.output != "rgba8" || opt.half;
+    if (reduced) {
+        if (!vk) throw std::runtime_error("--output/--half need the vulkan backend");
+        agbvk_set_output(vk, output_format(opt.output), opt.half ? 1 : 0);
+    }
+    if (opt.frameInfo) {
+        if (!vk) throw std::runtime_error("--frame-info needs the vulkan backend");
+        agbvk_set_frame_info(vk, 1);
+    }
+    AgbVkFrameInfo info{};
+    uint64_t changedSum = 0;   // over measured frames
+    const bool upscaled = upscale_mode(opt.upscale) != AGBVK_UPSCALE_NONE;
+    if (upscaled) {
+        if (!vk) throw std::runtime_error("--upscale needs the vulkan backend");
+        agbvk_set_upscale(vk, upscale_mode(opt.upscale));
+    }
+    std::vector<uint32_t> upRgba(upscaled ? FB_W * FB_H * 16 : 0);   // room for 4x
+
+    std::unique_ptr<AgbSyncCache> cache(new AgbSyncCache{});
+    agb_sync_cache_reset(cache.get());
+    AgbFrameSkip* skip = agb_frame_skip_create();
+    uint64_t skipped = 0;
+    std::vector<uint32_t> rgba(FB_W * FB_H);
+    size_t readBytes = rgba.size() * sizeof(uint32_t);   // of rgba, for the hash
+    const uint32_t* frame = nullptr;    // --acquire: the latest frame, in place
+    size_t frameStride = FB_W;
+    auto acquire_latest = [&]() {
+        if (frame) agb_renderer_release_frame(r);
+        if (!agb_renderer_acquire_frame(r, &frame, &frameStride)) frame = nullptr;
+    };
+    std::vector<uint64_t> samples[STAGE_COUNT];
+    for (auto& v : samples) v.reserve(opt.frames);
+
+    //--- Frame loop ----------------------------------------------------------------
+    const uint32_t total = opt.warmup + opt.frames;
+    Clock::time_point measureStart = Clock::now();
+    for (uint32_t f = 0; f < total; ++f) {
+        if (f == opt.warmup) measureStart = Clock::now();
+        const bool measured = f >= opt.warmup;
+        uint64_t t[STAGE_COUNT]{};
+        bool have[STAGE_COUNT]{};
+        const Clock::time_point frameStart = Clock::now();
+
+        // Scene updates are not timed; only the snapshot of the HAL is.
+        const AgbHwState* state = hw.get();
+        if (halScene) {
+            if (opt.animate) hal_scene_step(f);
+            Clock::time_point t0 = Clock::now();
+            gba::snapshot_to(opt.zeroCopy ? *agb_renderer_map_state(r) : *hw);
+            t[ST_SNAPSHOT] = since_ns(t0); have[ST_SNAPSHOT] = true;
+        } else if (!capture.empty()) {
+            state = &capture[f % capture.size()];
+        } else if (stressScene) {
+            if (opt.animate) agb_scene_animate(hw.get(), &stress, f);
+        } else if (opt.animate) {
+            demo_scene_step(*hw, *base, f);
+        }
+
+        Clock::time_point t0 = Clock::now();
+        if (opt.frameSkip) {
+            const int composed = agb_present_to_backend(state, r, skip, FB_W, FB_H, MAP_W, MAP_H,
+                OBJ_CHAR_BASE, OBJ_MAP_MODE, rgba.data(), rgba.size());
+            t[ST_PRESENT] = since_ns(t0); have[ST_PRESENT] = true;
+            if (measured && !composed) ++skipped;
+        } else {
+            if (!opt.zeroCopy) {
+                if (opt.fullSync) agb_sync_to_backend(state, r);
+                else agb_sync_to_backend_delta(state, r, cache.get());
+                t[ST_SYNC] = since_ns(t0); have[ST_SYNC] = true;
+            }
+
+            if (vk) {
+                t0 = Clock::now();
+                const uint64_t ticket = agbvk_submit_frame(vk, FB_W, FB_H, MAP_W, MAP_H, OBJ_CHAR_BASE, OBJ_MAP_MODE);
+                t[ST_SUBMIT] = since_ns(t0); have[ST_SUBMIT] = true;
+
+                t0 = Clock::now();
+                agbvk_wait_frame(vk, ticket);
+                t[ST_WAIT] = since_ns(t0); have[ST_WAIT] = true;
+
+                have[ST_GPU] = agbvk_gpu_time_ns(vk, ticket, &t[ST_GPU]) == 1;
+                if (opt.frameInfo && agbvk_frame_info(vk, ticket, 0, &info) == 1 && measured)
+                    changedSum += info.changedPixels;
+
+                t0 = Clock::now();
+                if (opt.acquire) acquire_latest();
+                else if (reduced) readBytes = agbvk_readback_output(vk, rgba.data(), rgba.size() * sizeof(uint32_t));
+                else agbvk_try_readback(vk, ticket, rgba.data(), rgba.size());
+                if (upscaled) agbvk_readback_upscaled(vk, upRgba.data(), upRgba.size());
+                t[ST_READBACK] = since_ns(t0); have[ST_READBACK] = true;
+            } else {
+                t0 = Clock::now();
+                agb_renderer_dispatch_frame(r, FB_W, FB_H, MAP_W, MAP_H, OBJ_CHAR_BASE, OBJ_MAP_MODE);
+                t[ST_SUBMIT] = since_ns(t0); have[ST_SUBMIT] = true;
+
+                t0 = Clock::now();
+                if (opt.acquire) acquire_latest();
+                else agb_renderer_readback_rgba(r, rgba.data(), rgba.size());
+                t[ST_READBACK] = since_ns(t0); have[ST_READBACK] = true;
+            }
+        }
+        t[ST_FRAME] = since_ns(frameStart); have[ST_FRAME] = true;
+
+        if (measured)
+            for (int s = 0; s < STAGE_COUNT; ++s)
+                if (have[s]) samples[s].push_back(t[s]);
+    }
+    const double wallS = double(since_ns(measureStart)) / 1e9;
+    const double fps = double(opt.frames) / wallS;
+
+    // FNV-1a of the last frame, to compare backends and catch blank output.
+    if (frame) {
+        for (uint32_t y = 0; y < FB_H; ++y)
+            std::copy(frame + y * frameStride, frame + y * frameStride + FB_W, rgba.begin() + y * FB_W);
+        agb_renderer_release_frame(r);
+    }
+    // A reduced output hashes its packed bytes instead.
+    uint64_t fnv = 1469598103934665603ull;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(rgba.data());
+    for (size_t i = 0; i < readBytes; ++i) { fnv ^= bytes[i]; fnv *= 1099511628211ull; }
+
+    // Memory types the Vulkan backend picked per buffer role.
+    static const char* const ROLE_NAMES[AGBVK_MEMORY_ROLE_COUNT] = { "shader", "upload", "readback" };
+    AgbVkMemoryInfo mem[AGBVK_MEMORY_ROLE_COUNT]{};
+    bool haveMem[AGBVK_MEMORY_ROLE_COUNT]{};
+    for (int m = 0; vk && m < AGBVK_MEMORY_ROLE_COUNT; ++m)
+        haveMem[m] = agbvk_memory_info(vk, AgbVkMemoryRole(m), &mem[m]) == 1;
+
+    const std::string backendName = agb_renderer_name(r);
+    agb_renderer_destroy(r);
+    agb_frame_skip_destroy(skip);
+
+    Summary sum[STAGE_COUNT];
+    for (int s = 0; s < STAGE_COUNT; ++s) sum[s] = summarize(std::move(samples[s]));
+
+    //--- Report --------------------------------------------------------------------
+    const bool jsonToStdout = opt.jsonPath == "-";
+    const char* syncMode = opt.zeroCopy ? "zero-copy" : opt.frameSkip ? "frame-skip" : opt.fullSync ? "full" : "delta";
+    const std::string readMode = (opt.acquire ? "acquire"
+        : reduced ? "output-" + opt.output + (opt.half ? "-half" : "") : "copy")
+        + (upscaled ? "+upscale-" + opt.upscale : "");
+    if (!jsonToStdout) {
+        std::printf("agb_bench: backend=%s scene=%s sync=%s readback=%s frames=%u warmup=%u\n",
+            backendName.c_str(), opt.scene.c_str(), syncMode, readMode.c_str(), opt.frames, opt.warmup);
+        std::printf("%-10s %10s %10s %10s %10s\n", "stage (us)", "p50", "p99", "max", "mean");
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            if (!sum[s].samples) continue;
+            std::printf("%-10s %10.1f %10.1f %10.1f %10.1f\n",
+                STAGE_NAMES[s], sum[s].p50, sum[s].p99, sum[s].max, sum[s].mean);
+        }
+        if (opt.frameSkip) std::printf("%llu of %u frames skipped\n", static_cast<unsigned long long>(skipped), opt.frames);
+        if (opt.frameInfo)
+            std::printf("gpu hash %016llx, %.1f changed px/frame\n", static_cast<unsigned long long>(info.hash),
+                double(changedSum) / opt.frames);
+        for (int m = 0; m < AGBVK_MEMORY_ROLE_COUNT; ++m)
+            if (haveMem[m])
+                std::printf("memory %-8s type %u (heap %u, flags 0x%x)\n",
+                    ROLE_NAMES[m], mem[m].typeIndex, mem[m].heapIndex, mem[m].propertyFlags);
+        std::printf("%.1f fps (%.3f s)\n", fps, wallS);
+    }
+
+    if (!opt.jsonPath.empty()) {
+        std::string j = "{\n";
+        char buf[256];
+        j += "  \"backend\": \"" + json_escape(backendName) + "\",\n";
+        j += "  \"scene\": \"" + json_escape(opt.scene) + "\",\n";
+        j += std::string("  \"sync\": \"") + syncMode + "\",\n";
+        j += std::string("  \"readback\": \"") + readMode + "\",\n";
+        std::snprintf(buf, sizeof(buf), "  \"frames\": %u,\n  \"warmup\": %u,\n  \"width\": %u,\n  \"height\": %u,\n",
+            opt.frames, opt.warmup, FB_W, FB_H);
+        j += buf;
+        std::snprintf(buf, sizeof(buf), "  \"wall_s\": %.6f,\n  \"fps\": %.3f,\n  \"last_frame_fnv1a\": \"%016llx\",\n",
+            wallS, fps, static_cast<unsigned long long>(fnv));
+        j += buf;
+        std::snprintf(buf, sizeof(buf), "  \"frames_skipped\": %llu,\n", static_cast<unsigned long long>(skipped));
+        j += buf;
+        if (opt.frameInfo) {
+            std::snprintf(buf, sizeof(buf), "  \"last_frame_gpu_hash\": \"%016llx\",\n  \"changed_px_mean\": %.3f,\n",
+                static_cast<unsigned long long>(info.hash), double(changedSum) / opt.frames);
+            j += buf;
+        }
+        j += "  \"stages_us\": {";
+        bool first = true;
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            if (!sum[s].samples) continue;
+            std::snprintf(buf, sizeof(buf),
+                "%s\n    \"%s\": { \"samples\": %zu, \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f, \"mean\": %.3f }",
+                first ? "" : ",", STAGE_NAMES[s], sum[s].samples, sum[s].p50, sum[s].p99, sum[s].max, sum[s].mean);
+            j += buf;
+            first = false;
+        }
+        j += "\n  }";
+        first = true;
+        for (int m = 0; m < AGBVK_MEMORY_ROLE_COUNT; ++m) {
+            if (!haveMem[m]) continue;
+            std::snprintf(buf, sizeof(buf), "%s\n    \"%s\": { \"type\": %u, \"heap\": %u, \"flags\": %u }",
+                first ? ",\n  \"memory_types\": {" : ",", ROLE_NAMES[m], mem[m].typeIndex, mem[m].heapIndex,
+                mem[m].propertyFlags);
+            j += buf;
+            first = false;
+        }
+        if (!first) j += "\n  }";
+        j += "\n}\n";
+
+        if (jsonToStdout) {
+            std::cout << j;
+        } else {
+            std::ofstream out(opt.jsonPath);
+            if (!out) throw std::runtime_error("cannot write " + opt.jsonPath);
+            out << j;
+        }
+    }
+    return 0;
+}
+catch (const UsageError& e)
+{
+    std::cerr << "agb_bench: " << e.what() << "\n";
+    usage();
+    return 2;
+}
+catch (const std::exception& e)
+{
+    std::cerr << "agb_bench: " << e.what() << "\n";
+    return 1;
+}
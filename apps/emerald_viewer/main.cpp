@@ -8,10 +8,8 @@ int main()
     // 1) Bring up renderer
     AgbVkCtx* ctx = agbvk_create();
 
-    // 2) Snapshot empty HAL → renderer (still draws nothing interesting)
-    AgbHwState hw{};
-    gba::snapshot_to(hw);
-    agb_sync_to_renderer(&hw, ctx);
+    // 2) Snapshot empty HAL straight into the renderer's mapped state (no sync copy)
+    gba::snapshot_to(*agbvk_map_state(ctx));
 
     // 3) Dispatch once with the same push-consts as frame_viewer
     agbvk_dispatch_frame(ctx, 240, 160, 32, 32, 32 * 1024, /*objMapMode*/0);
@@ -6,8 +6,8 @@
 #include <filesystem>
 #include <stdexcept>
 
-#include "agb_vk.h"
 #include "agb_bridge.h"
+#include "agb_renderer.h"
 
 int main() try
 {
@@ -22,10 +22,12 @@ int main() try
 #endif
 
     //--- Create renderer + build the exact demo scene in host memory --------------
-    AgbVkCtx* ctx = agbvk_create();
+    AgbRenderer* ctx = agb_renderer_create(AGB_RENDERER_AUTO);   // $AGB_RENDERER=vulkan|cpu|null
+    if (!ctx) throw std::runtime_error("No renderer backend available.");
+    cout << "Renderer: " << agb_renderer_name(ctx) << "\n";
     AgbHwState hw{};
     agb_init_hw(&hw);                 // fill VRAM/pal/OAM/BG params/windows/FX/scan/affine (host)  :contentReference[oaicite:1]{index=1}
-    agb_sync_to_renderer(&hw, ctx);   // copy host state into the 11 SSBOs (descriptor 1..10)       :contentReference[oaicite:2]{index=2}
+    agb_sync_to_backend(&hw, ctx);    // copy host state into the renderer's state buffer
 
     //--- Dispatch one frame (push-consts mirror original prototype) ---------------
     constexpr uint32_t FB_W = 240;
@@ -35,26 +37,39 @@ int main() try
     constexpr uint32_t OBJ_CHAR_BASE = 32 * 1024; // bytes into VRAM where OBJ tiles live
     constexpr uint32_t OBJ_MAP_MODE = 0;         // 0 = 2D mapping, 1 = 1D
 
-    agbvk_dispatch_frame(ctx, FB_W, FB_H, MAP_W, MAP_H, OBJ_CHAR_BASE, OBJ_MAP_MODE);  // :contentReference[oaicite:3]{index=3}
+    agb_renderer_dispatch_frame(ctx, FB_W, FB_H, MAP_W, MAP_H, OBJ_CHAR_BASE, OBJ_MAP_MODE);
 
-    //--- Readback and write PPM (RGB from RGBA8) ----------------------------------
-    std::vector<uint32_t> rgba(FB_W * FB_H);
-    agbvk_readback_rgba(ctx, rgba.data(), rgba.size());                                  // :contentReference[oaicite:4]{index=4}
+    //--- Write PPM (RGB from RGBA8) straight from the renderer's framebuffer -------
+    // Backends without in-place access fall back to a readback copy.
+    const uint32_t* pixels = nullptr;
+    size_t stride = FB_W;
+    std::vector<uint32_t> rgba;
+    const bool acquired = agb_renderer_acquire_frame(ctx, &pixels, &stride) != 0;
+    if (!acquired) {
+        rgba.resize(FB_W * FB_H);
+        agb_renderer_readback_rgba(ctx, rgba.data(), rgba.size());
+        pixels = rgba.data();
+    }
 
     std::ofstream ppm("hello_frame.ppm", std::ios::binary);
     if (!ppm) throw std::runtime_error("Cannot open hello_frame.ppm for writing.");
     ppm << "P6\n" << FB_W << " " << FB_H << "\n255\n";
-    for (uint32_t px : rgba) {
-        unsigned char r = static_cast<unsigned char>((px >> 0) & 0xFF);
-        unsigned char g = static_cast<unsigned char>((px >> 8) & 0xFF);
-        unsigned char b = static_cast<unsigned char>((px >> 16) & 0xFF);
-        ppm.put(r).put(g).put(b);
+    std::vector<char> row(FB_W * 3);
+    for (uint32_t y = 0; y < FB_H; ++y) {
+        const uint32_t* src = pixels + y * stride;
+        for (uint32_t x = 0; x < FB_W; ++x) {
+            row[x * 3 + 0] = static_cast<char>((src[x] >> 0) & 0xFF);
+            row[x * 3 + 1] = static_cast<char>((src[x] >> 8) & 0xFF);
+            row[x * 3 + 2] = static_cast<char>((src[x] >> 16) & 0xFF);
+        }
+        ppm.write(row.data(), std::streamsize(row.size()));
     }
     ppm.close();
+    if (acquired) agb_renderer_release_frame(ctx);
     cout << "Wrote hello_frame.ppm in: " << std::filesystem::current_path().string() << "\n";
 
     //--- Cleanup ------------------------------------------------------------------
-    agbvk_destroy(ctx);
+    agb_renderer_destroy(ctx);
     return 0;
 }
 catch (const std::exception& e)
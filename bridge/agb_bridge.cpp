@@ -1,8 +1,12 @@
 #include "agb_bridge.h"
-#include "agb_vk.h"
+#include "agb_renderer.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
 #include <cstring>
+#include <vector>
 
 // --- small helpers (host-side, Vulkan-free) ---------------------------------
 
@@ -308,26 +312,249 @@ void agb_init_hw(AgbHwState* hw) {
     }
 }
 
-// Copy host state into the renderer's SSBOs (descriptor order: 1..10)
-void agb_sync_to_renderer(const AgbHwState* hw, AgbVkCtx* ctx) {
-    if (!hw || !ctx) return;
-
+// Copy host state into the renderer, one upload per input (AgbInput order)
+static void sync_full(const AgbRendererOps* ops, void* impl, const AgbHwState* hw) {
     // 1) VRAM / 2) PAL BG / 3) BG params / 4) PAL OBJ / 5) OAM
-    agbvk_upload_vram(ctx, hw->vram, AGB_VRAM_SIZE);
-    agbvk_upload_pal_bg(ctx, hw->pal_bg, AGB_PAL_BG_SIZE);
-    agbvk_upload_bg_params(ctx, reinterpret_cast<const uint32_t*>(hw->bg_params),
-        AGB_BG_COUNT * AGB_BG_PARAM_DWORDS);
-    agbvk_upload_pal_obj(ctx, hw->pal_obj, AGB_PAL_OBJ_SIZE);
-    agbvk_upload_oam(ctx, hw->oam, AGB_OAM_SIZE);
+    ops->upload(impl, AGB_INPUT_VRAM, 0, hw->vram, AGB_VRAM_SIZE);
+    ops->upload(impl, AGB_INPUT_PAL_BG, 0, hw->pal_bg, AGB_PAL_BG_SIZE);
+    ops->upload(impl, AGB_INPUT_BG_PARAMS, 0, hw->bg_params, sizeof(hw->bg_params));
+    ops->upload(impl, AGB_INPUT_PAL_OBJ, 0, hw->pal_obj, AGB_PAL_OBJ_SIZE);
+    ops->upload(impl, AGB_INPUT_OAM, 0, hw->oam, AGB_OAM_SIZE);
 
     // 6) WIN / 7) FX / 8) Scanline overrides
-    agbvk_upload_win(ctx, &hw->win, sizeof(hw->win));
-    agbvk_upload_fx(ctx, &hw->fx, sizeof(hw->fx));
-    agbvk_upload_scanline(ctx, hw->scan, AGB_SCANLINES * sizeof(Scanline));
+    ops->upload(impl, AGB_INPUT_WIN, 0, &hw->win, sizeof(hw->win));
+    ops->upload(impl, AGB_INPUT_FX, 0, &hw->fx, sizeof(hw->fx));
+    ops->upload(impl, AGB_INPUT_SCANLINE, 0, hw->scan, AGB_SCANLINES * sizeof(Scanline));
 
     // 9) BG affine / 10) OBJ affine
-    agbvk_upload_bg_aff(ctx, reinterpret_cast<const int32_t*>(hw->bgAff),
-        AGB_BG_AFF_COUNT * 6);
-    agbvk_upload_obj_aff(ctx, reinterpret_cast<const int32_t*>(hw->objAff),
-        AGB_OBJ_AFF_COUNT * 4);
+    ops->upload(impl, AGB_INPUT_BG_AFF, 0, hw->bgAff, sizeof(hw->bgAff));
+    ops->upload(impl, AGB_INPUT_OBJ_AFF, 0, hw->objAff, sizeof(hw->objAff));
+}
+
+void agb_sync_to_renderer(const AgbHwState* hw, AgbVkCtx* ctx) {
+    if (!hw || !ctx) return;
+    sync_full(&agb_renderer_vulkan, ctx, hw);
+}
+
+void agb_sync_to_backend(const AgbHwState* hw, AgbRenderer* r) {
+    if (!hw || !r) return;
+    sync_full(agb_renderer_ops(r), agb_renderer_impl(r), hw);
+}
+
+// --- Incremental sync -------------------------------------------------------
+
+void agb_sync_cache_reset(AgbSyncCache* cache) {
+    if (cache) cache->valid = 0;
+}
+
+// Compare `cur` against `last` in `granule`-sized blocks, upload each run of
+// changed blocks with one range call and fold it into `last`.
+static uint32_t sync_runs(const AgbRendererOps* ops, void* impl, AgbInput input, const uint8_t* cur, uint8_t* last,
+    size_t size, size_t granule, bool force) {
+    uint32_t sent = 0;
+    for (size_t off = 0; off < size; ) {
+        size_t len = std::min(granule, size - off);
+        if (!force && std::memcmp(cur + off, last + off, len) == 0) { off += len; continue; }
+
+        size_t end = off + len;
+        while (end < size) {
+            size_t n = std::min(granule, size - end);
+            if (!force && std::memcmp(cur + end, last + end, n) == 0) break;
+            end += n;
+        }
+        ops->upload(impl, input, off, cur + off, end - off);
+        std::memcpy(last + off, cur + off, end - off);
+        sent += static_cast<uint32_t>(end - off);
+        off = end;
+    }
+    return sent;
+}
+
+// Small register blocks are sent whole when any byte changed.
+template <typename T>
+static uint32_t sync_block(const AgbRendererOps* ops, void* impl, AgbInput input, const T& cur, T& last, bool force) {
+    if (!force && std::memcmp(&cur, &last, sizeof(T)) == 0) return 0;
+    std::memcpy(&last, &cur, sizeof(T));
+    ops->upload(impl, input, 0, &cur, sizeof(T));
+    return sizeof(T);
+}
+
+static void sync_delta(const AgbRendererOps* ops, void* impl, const AgbHwState* hw, AgbSyncCache* cache) {
+    const bool force = (cache->valid == 0);
+    AgbHwState& last = cache->last;
+    uint32_t sent = 0;
+
+    // Byte storages: 1 KB pages; scanlines: one record per line
+    sent += sync_runs(ops, impl, AGB_INPUT_VRAM, hw->vram, last.vram, AGB_VRAM_SIZE, AGB_SYNC_PAGE_SIZE, force);
+    sent += sync_runs(ops, impl, AGB_INPUT_PAL_BG, hw->pal_bg, last.pal_bg, AGB_PAL_BG_SIZE, AGB_SYNC_PAGE_SIZE, force);
+    sent += sync_runs(ops, impl, AGB_INPUT_PAL_OBJ, hw->pal_obj, last.pal_obj, AGB_PAL_OBJ_SIZE, AGB_SYNC_PAGE_SIZE, force);
+    sent += sync_runs(ops, impl, AGB_INPUT_OAM, hw->oam, last.oam, AGB_OAM_SIZE, AGB_SYNC_PAGE_SIZE, force);
+    sent += sync_runs(ops, impl, AGB_INPUT_SCANLINE,
+        reinterpret_cast<const uint8_t*>(hw->scan), reinterpret_cast<uint8_t*>(last.scan),
+        sizeof(hw->scan), sizeof(Scanline), force);
+
+    sent += sync_block(ops, impl, AGB_INPUT_BG_PARAMS, hw->bg_params, last.bg_params, force);
+    sent += sync_block(ops, impl, AGB_INPUT_WIN, hw->win, last.win, force);
+    sent += sync_block(ops, impl, AGB_INPUT_FX, hw->fx, last.fx, force);
+    sent += sync_block(ops, impl, AGB_INPUT_BG_AFF, hw->bgAff, last.bgAff, force);
+    sent += sync_block(ops, impl, AGB_INPUT_OBJ_AFF, hw->objAff, last.objAff, force);
+
+    cache->valid = 1;
+    cache->lastUploadBytes = sent;
+}
+
+void agb_sync_to_renderer_delta(const AgbHwState* hw, AgbVkCtx* ctx, AgbSyncCache* cache) {
+    if (!hw || !ctx) return;
+    if (!cache) { agb_sync_to_renderer(hw, ctx); return; }
+    sync_delta(&agb_renderer_vulkan, ctx, hw, cache);
+}
+
+void agb_sync_to_backend_delta(const AgbHwState* hw, AgbRenderer* r, AgbSyncCache* cache) {
+    if (!hw || !r) return;
+    if (!cache) { agb_sync_to_backend(hw, r); return; }
+    sync_delta(agb_renderer_ops(r), agb_renderer_impl(r), hw, cache);
+}
+
+// --- Frame skip ---------------------------------------------------------------
+
+namespace {
+
+// A hashed span of AgbHwState and where it lands in its renderer input.
+struct HashRegion {
+    AgbInput input;
+    size_t   stateOff;   // byte offset in AgbHwState
+    size_t   inputOff;   // byte offset in the input
+    size_t   len;
+};
+
+// Same granularity as the delta sync: 1 KB pages, one record per scanline,
+// whole register blocks. Regions of an input are adjacent and in order, so
+// runs of changed ones upload as one range.
+const std::vector<HashRegion>& hash_regions() {
+    static const std::vector<HashRegion> regions = [] {
+        std::vector<HashRegion> r;
+        auto pages = [&r](AgbInput in, size_t off, size_t size, size_t granule) {
+            for (size_t o = 0; o < size; o += granule) r.push_back({ in, off + o, o, std::min(granule, size - o) });
+        };
+        pages(AGB_INPUT_VRAM, offsetof(AgbHwState, vram), AGB_VRAM_SIZE, AGB_SYNC_PAGE_SIZE);
+        pages(AGB_INPUT_PAL_BG, offsetof(AgbHwState, pal_bg), AGB_PAL_BG_SIZE, AGB_SYNC_PAGE_SIZE);
+        pages(AGB_INPUT_PAL_OBJ, offsetof(AgbHwState, pal_obj), AGB_PAL_OBJ_SIZE, AGB_SYNC_PAGE_SIZE);
+        pages(AGB_INPUT_OAM, offsetof(AgbHwState, oam), AGB_OAM_SIZE, AGB_SYNC_PAGE_SIZE);
+        pages(AGB_INPUT_SCANLINE, offsetof(AgbHwState, scan), sizeof(AgbHwState::scan), sizeof(Scanline));
+        r.push_back({ AGB_INPUT_BG_PARAMS, offsetof(AgbHwState, bg_params), 0, sizeof(AgbHwState::bg_params) });
+        r.push_back({ AGB_INPUT_WIN, offsetof(AgbHwState, win), 0, sizeof(WinState) });
+        r.push_back({ AGB_INPUT_FX, offsetof(AgbHwState, fx), 0, sizeof(FxRegs) });
+        r.push_back({ AGB_INPUT_BG_AFF, offsetof(AgbHwState, bgAff), 0, sizeof(AgbHwState::bgAff) });
+        r.push_back({ AGB_INPUT_OBJ_AFF, offsetof(AgbHwState, objAff), 0, sizeof(AgbHwState::objAff) });
+        return r;
+    }();
+    return regions;
+}
+
+inline uint64_t rotl64(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+// 64-bit multiply-rotate hash over 8-byte words, four independent lanes per
+// 32-byte block so the multiplies overlap.
+uint64_t hash_bytes(const uint8_t* p, size_t n) {
+    const uint64_t K1 = 0x87C37B91114253D5ull, K2 = 0x4CF5AD432745937Full;
+    uint64_t lane[4] = { 0x9E3779B97F4A7C15ull ^ n, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x85EBCA77C2B2AE63ull };
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int k = 0; k < 4; ++k) {
+            uint64_t w; std::memcpy(&w, p + i + 8 * k, 8);
+            lane[k] = rotl64(lane[k] ^ (w * K1), 31) * K2;
+        }
+    }
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w; std::memcpy(&w, p + i, 8);
+        lane[0] = rotl64(lane[0] ^ (w * K1), 31) * K2;
+    }
+    for (; i < n; ++i) lane[0] = (lane[0] ^ p[i]) * 0x100000001B3ull;
+    uint64_t h = lane[0] ^ rotl64(lane[1], 17) ^ rotl64(lane[2], 29) ^ rotl64(lane[3], 43);
+    h ^= h >> 33; h *= K1; h ^= h >> 29;
+    return h;
+}
+
+} // namespace
+
+struct AgbFrameSkip {
+    std::vector<uint64_t> hash;      // per hash_regions() entry, as last presented
+    std::vector<uint8_t>  changed;   // scratch
+    std::array<uint32_t, 6> pc{};    // dispatch parameters of the last composed frame
+    std::vector<uint32_t> rgba;      // its framebuffer
+    bool                  valid = false;
+    AgbFrameSkipStats     stats{};
+};
+
+AgbFrameSkip* agb_frame_skip_create(void) {
+    AgbFrameSkip* skip = new AgbFrameSkip();
+    skip->hash.resize(hash_regions().size());
+    skip->changed.resize(hash_regions().size());
+    return skip;
+}
+
+void agb_frame_skip_destroy(AgbFrameSkip* skip) { delete skip; }
+
+void agb_frame_skip_reset(AgbFrameSkip* skip) {
+    if (skip) skip->valid = false;
+}
+
+void agb_frame_skip_stats(const AgbFrameSkip* skip, AgbFrameSkipStats* out) {
+    if (skip && out) *out = skip->stats;
+}
+
+static int present(const AgbRendererOps* ops, void* impl, const AgbHwState* hw, AgbFrameSkip* skip,
+    const std::array<uint32_t, 6>& pc, uint32_t* dstRGBA, size_t pixelCount) {
+    const std::vector<HashRegion>& regions = hash_regions();
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(hw);
+
+    uint32_t nChanged = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        const uint64_t h = hash_bytes(base + regions[i].stateOff, regions[i].len);
+        skip->changed[i] = !skip->valid || h != skip->hash[i];
+        skip->hash[i] = h;
+        nChanged += skip->changed[i];
+    }
+
+    if (nChanged == 0 && skip->pc == pc && skip->rgba.size() == pixelCount) {
+        std::memcpy(dstRGBA, skip->rgba.data(), pixelCount * sizeof(uint32_t));
+        ++skip->stats.framesSkipped;
+        return 0;
+    }
+
+    // Upload runs of changed regions that are contiguous in one input.
+    uint32_t sent = 0;
+    for (size_t i = 0; i < regions.size(); ) {
+        if (!skip->changed[i]) { ++i; continue; }
+        size_t j = i + 1, len = regions[i].len;
+        while (j < regions.size() && skip->changed[j] && regions[j].input == regions[i].input) len += regions[j++].len;
+        ops->upload(impl, regions[i].input, regions[i].inputOff, base + regions[i].stateOff, len);
+        sent += static_cast<uint32_t>(len);
+        i = j;
+    }
+
+    ops->dispatch_frame(impl, pc[0], pc[1], pc[2], pc[3], pc[4], pc[5]);
+    ops->readback_rgba(impl, dstRGBA, pixelCount);
+    skip->rgba.assign(dstRGBA, dstRGBA + pixelCount);
+    skip->pc = pc;
+    skip->valid = true;
+    ++skip->stats.framesComposed;
+    skip->stats.lastChangedRegions = nChanged;
+    skip->stats.lastUploadBytes = sent;
+    return 1;
+}
+
+int agb_present_to_renderer(const AgbHwState* hw, AgbVkCtx* ctx, AgbFrameSkip* skip,
+    uint32_t fbW, uint32_t fbH, uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode,
+    uint32_t* dstRGBA, size_t pixelCount) {
+    if (!hw || !ctx || !skip || !dstRGBA) return 0;
+    return present(&agb_renderer_vulkan, ctx, hw, skip, { fbW, fbH, mapW, mapH, objCharBase, objMapMode }, dstRGBA, pixelCount);
+}
+
+int agb_present_to_backend(const AgbHwState* hw, AgbRenderer* r, AgbFrameSkip* skip,
+    uint32_t fbW, uint32_t fbH, uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode,
+    uint32_t* dstRGBA, size_t pixelCount) {
+    if (!hw || !r || !skip || !dstRGBA) return 0;
+    return present(agb_renderer_ops(r), agb_renderer_impl(r), hw, skip,
+        { fbW, fbH, mapW, mapH, objCharBase, objMapMode }, dstRGBA, pixelCount);
 }
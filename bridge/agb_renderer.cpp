@@ -0,0 +1,251 @@
+#include "agb_renderer.h"
+#include "agb_bridge.h"
+#include "agb_vk.h"
+#include "agb_cpu.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct AgbRenderer {
+    const AgbRendererOps* ops;
+    void* impl;
+};
+
+// ---- Vulkan backend ---------------------------------------------------------
+static void* vk_create() { return agbvk_create(); }
+static void  vk_destroy(void* c) { agbvk_destroy(static_cast<AgbVkCtx*>(c)); }
+
+static void vk_upload(void* impl, AgbInput input, size_t off, const void* bytes, size_t n) {
+    AgbVkCtx* c = static_cast<AgbVkCtx*>(impl);
+    switch (input) {
+    case AGB_INPUT_VRAM:     agbvk_upload_vram_range(c, off, bytes, n); return;
+    case AGB_INPUT_PAL_BG:   agbvk_upload_pal_bg_range(c, off, bytes, n); return;
+    case AGB_INPUT_PAL_OBJ:  agbvk_upload_pal_obj_range(c, off, bytes, n); return;
+    case AGB_INPUT_OAM:      agbvk_upload_oam_range(c, off, bytes, n); return;
+    case AGB_INPUT_SCANLINE: agbvk_upload_scanline_range(c, off, bytes, n); return;
+    default: break;
+    }
+    if (off != 0) return;   // register blocks are written whole
+    switch (input) {
+    case AGB_INPUT_BG_PARAMS: agbvk_upload_bg_params(c, static_cast<const uint32_t*>(bytes), n / sizeof(uint32_t)); break;
+    case AGB_INPUT_WIN:       agbvk_upload_win(c, bytes, n); break;
+    case AGB_INPUT_FX:        agbvk_upload_fx(c, bytes, n); break;
+    case AGB_INPUT_BG_AFF:    agbvk_upload_bg_aff(c, static_cast<const int32_t*>(bytes), n / sizeof(int32_t)); break;
+    case AGB_INPUT_OBJ_AFF:   agbvk_upload_obj_aff(c, static_cast<const int32_t*>(bytes), n / sizeof(int32_t)); break;
+    default: break;
+    }
+}
+
+static void vk_dispatch(void* c, uint32_t fbW, uint32_t fbH, uint32_t mapW, uint32_t mapH,
+    uint32_t objCharBase, uint32_t objMapMode) {
+    agbvk_dispatch_frame(static_cast<AgbVkCtx*>(c), fbW, fbH, mapW, mapH, objCharBase, objMapMode);
+}
+static void vk_readback(void* c, uint32_t* dst, size_t n) { agbvk_readback_rgba(static_cast<AgbVkCtx*>(c), dst, n); }
+static void vk_batch(void* c, const AgbHwState* s, size_t n, uint32_t* out) {
+    agbvk_render_batch(static_cast<AgbVkCtx*>(c), s, n, out);
+}
+static AgbHwState* vk_map_state(void* c) { return agbvk_map_state(static_cast<AgbVkCtx*>(c)); }
+static int vk_acquire(void* c, const uint32_t** px, size_t* stride) {
+    return agbvk_acquire_frame(static_cast<AgbVkCtx*>(c), px, stride);
+}
+static void vk_release(void* c) { agbvk_release_frame(static_cast<AgbVkCtx*>(c)); }
+static void vk_rect(void* c, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t* dst, size_t stride) {
+    agbvk_readback_rect(static_cast<AgbVkCtx*>(c), x, y, w, h, dst, stride);
+}
+
+extern "C" const AgbRendererOps agb_renderer_vulkan = {
+    "vulkan", vk_create, vk_destroy, vk_upload, vk_dispatch, vk_readback, vk_batch, vk_map_state,
+    vk_acquire, vk_release, vk_rect,
+};
+
+// ---- CPU backend --------------------------------------------------------------
+static void* cpu_create() { return agbcpu_create(); }
+static void  cpu_destroy(void* c) { agbcpu_destroy(static_cast<AgbCpuCtx*>(c)); }
+
+static void cpu_upload(void* impl, AgbInput input, size_t off, const void* bytes, size_t n) {
+    AgbCpuCtx* c = static_cast<AgbCpuCtx*>(impl);
+    switch (input) {
+    case AGB_INPUT_VRAM:     agbcpu_upload_vram_range(c, off, bytes, n); return;
+    case AGB_INPUT_PAL_BG:   agbcpu_upload_pal_bg_range(c, off, bytes, n); return;
+    case AGB_INPUT_PAL_OBJ:  agbcpu_upload_pal_obj_range(c, off, bytes, n); return;
+    case AGB_INPUT_OAM:      agbcpu_upload_oam_range(c, off, bytes, n); return;
+    case AGB_INPUT_SCANLINE: agbcpu_upload_scanline_range(c, off, bytes, n); return;
+    default: break;
+    }
+    if (off != 0) return;   // register blocks are written whole
+    switch (input) {
+    case AGB_INPUT_BG_PARAMS: agbcpu_upload_bg_params(c, static_cast<const uint32_t*>(bytes), n / sizeof(uint32_t)); break;
+    case AGB_INPUT_WIN:       agbcpu_upload_win(c, bytes, n); break;
+    case AGB_INPUT_FX:        agbcpu_upload_fx(c, bytes, n); break;
+    case AGB_INPUT_BG_AFF:    agbcpu_upload_bg_aff(c, static_cast<const int32_t*>(bytes), n / sizeof(int32_t)); break;
+    case AGB_INPUT_OBJ_AFF:   agbcpu_upload_obj_aff(c, static_cast<const int32_t*>(bytes), n / sizeof(int32_t)); break;
+    default: break;
+    }
+}
+
+static void cpu_dispatch(void* c, uint32_t fbW, uint32_t fbH, uint32_t mapW, uint32_t mapH,
+    uint32_t objCharBase, uint32_t objMapMode) {
+    agbcpu_dispatch_frame(static_cast<AgbCpuCtx*>(c), fbW, fbH, mapW, mapH, objCharBase, objMapMode);
+}
+static void cpu_readback(void* c, uint32_t* dst, size_t n) { agbcpu_readback_rgba(static_cast<AgbCpuCtx*>(c), dst, n); }
+static void cpu_batch(void* c, const AgbHwState* s, size_t n, uint32_t* out) {
+    agbcpu_render_batch(static_cast<AgbCpuCtx*>(c), s, n, out);
+}
+static AgbHwState* cpu_map_state(void* c) { return agbcpu_map_state(static_cast<AgbCpuCtx*>(c)); }
+static int cpu_acquire(void* c, const uint32_t** px, size_t* stride) {
+    return agbcpu_acquire_frame(static_cast<AgbCpuCtx*>(c), px, stride);
+}
+static void cpu_release(void* c) { agbcpu_release_frame(static_cast<AgbCpuCtx*>(c)); }
+static void cpu_rect(void* c, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t* dst, size_t stride) {
+    agbcpu_readback_rect(static_cast<AgbCpuCtx*>(c), x, y, w, h, dst, stride);
+}
+
+extern "C" const AgbRendererOps agb_renderer_cpu = {
+    "cpu", cpu_create, cpu_destroy, cpu_upload, cpu_dispatch, cpu_readback, cpu_batch, cpu_map_state,
+    cpu_acquire, cpu_release, cpu_rect,
+};
+
+// ---- Null backend ---------------------------------------------------------------
+// Keeps only the latest framebuffer size, so readbacks and batches still
+// write the pixel counts a real backend would, plus a state nobody reads and
+// a zeroed framebuffer for acquire_frame.
+struct NullCtx { uint32_t fbW = 240, fbH = 160; AgbHwState state; std::vector<uint32_t> fb; };
+
+static void* null_create() { return new NullCtx(); }
+static void  null_destroy(void* c) { delete static_cast<NullCtx*>(c); }
+static void  null_upload(void*, AgbInput, size_t, const void*, size_t) {}
+static void  null_dispatch(void* c, uint32_t fbW, uint32_t fbH, uint32_t, uint32_t, uint32_t, uint32_t) {
+    NullCtx* nc = static_cast<NullCtx*>(c);
+    nc->fbW = fbW;
+    nc->fbH = fbH;
+    nc->fb.assign(size_t(fbW) * fbH, 0);
+}
+static void null_readback(void* c, uint32_t* dst, size_t n) {
+    const NullCtx* nc = static_cast<NullCtx*>(c);
+    const size_t fb = size_t(nc->fbW) * nc->fbH;
+    std::memset(dst, 0, (n < fb ? n : fb) * sizeof(uint32_t));
+}
+static void null_batch(void* c, const AgbHwState*, size_t n, uint32_t* out) {
+    const NullCtx* nc = static_cast<NullCtx*>(c);
+    std::memset(out, 0, n * nc->fbW * nc->fbH * sizeof(uint32_t));
+}
+static AgbHwState* null_map_state(void* c) { return &static_cast<NullCtx*>(c)->state; }
+static int null_acquire(void* c, const uint32_t** px, size_t* stride) {
+    const NullCtx* nc = static_cast<NullCtx*>(c);
+    if (nc->fb.empty()) return 0;
+    *px = nc->fb.data();
+    *stride = nc->fbW;
+    return 1;
+}
+static void null_release(void*) {}
+static void null_rect(void* c, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t* dst, size_t stride) {
+    const NullCtx* nc = static_cast<NullCtx*>(c);
+    if (x >= nc->fbW || y >= nc->fbH) return;
+    w = std::min(w, nc->fbW - x);
+    h = std::min(h, nc->fbH - y);
+    for (uint32_t row = 0; row < h; ++row) std::memset(dst + row * stride, 0, w * sizeof(uint32_t));
+}
+
+extern "C" const AgbRendererOps agb_renderer_null = {
+    "null", null_create, null_destroy, null_upload, null_dispatch, null_readback, null_batch, null_map_state,
+    null_acquire, null_release, null_rect,
+};
+
+// ---- Selection --------------------------------------------------------------------
+static const AgbRendererOps* ops_for(AgbRendererKind kind) {
+    switch (kind) {
+    case AGB_RENDERER_VULKAN: return &agb_renderer_vulkan;
+    case AGB_RENDERER_CPU:    return &agb_renderer_cpu;
+    case AGB_RENDERER_NULL:   return &agb_renderer_null;
+    default:                  return nullptr;
+    }
+}
+
+static AgbRendererKind kind_from_env() {
+    const char* env = std::getenv(AGB_RENDERER_ENV);
+    if (!env || !*env) return AGB_RENDERER_AUTO;
+    const std::string v(env);
+    if (v == "vulkan") return AGB_RENDERER_VULKAN;
+    if (v == "cpu") return AGB_RENDERER_CPU;
+    if (v == "null") return AGB_RENDERER_NULL;
+    std::cerr << AGB_RENDERER_ENV << "=" << v << " is not a renderer (vulkan, cpu, null); picking automatically\n";
+    return AGB_RENDERER_AUTO;
+}
+
+extern "C" {
+
+AgbRenderer* agb_renderer_create_with_ops(const AgbRendererOps* ops) {
+    if (!ops) return nullptr;
+    void* impl = nullptr;
+    try {
+        impl = ops->create();
+    } catch (const std::exception& e) {
+        std::cerr << "renderer '" << ops->name << "' unavailable: " << e.what() << "\n";
+    }
+    if (!impl) return nullptr;
+    return new AgbRenderer{ ops, impl };
+}
+
+AgbRenderer* agb_renderer_create(AgbRendererKind kind) {
+    if (kind == AGB_RENDERER_AUTO) kind = kind_from_env();
+    if (kind != AGB_RENDERER_AUTO) return agb_renderer_create_with_ops(ops_for(kind));
+
+    // No preference: the GPU when there is one, else the CPU compositor.
+    if (AgbRenderer* r = agb_renderer_create_with_ops(&agb_renderer_vulkan)) return r;
+    return agb_renderer_create_with_ops(&agb_renderer_cpu);
+}
+
+void agb_renderer_destroy(AgbRenderer* r) {
+    if (!r) return;
+    r->ops->destroy(r->impl);
+    delete r;
+}
+
+const char* agb_renderer_name(const AgbRenderer* r) { return r->ops->name; }
+const AgbRendererOps* agb_renderer_ops(const AgbRenderer* r) { return r->ops; }
+void* agb_renderer_impl(AgbRenderer* r) { return r->impl; }
+
+AgbVkCtx* agb_renderer_vk(AgbRenderer* r) {
+    return (r && r->ops == &agb_renderer_vulkan) ? static_cast<AgbVkCtx*>(r->impl) : nullptr;
+}
+
+void agb_renderer_upload(AgbRenderer* r, AgbInput input, size_t offset, const void* bytes, size_t countBytes) {
+    r->ops->upload(r->impl, input, offset, bytes, countBytes);
+}
+
+void agb_renderer_dispatch_frame(AgbRenderer* r, uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode) {
+    r->ops->dispatch_frame(r->impl, fbW, fbH, mapW, mapH, objCharBase, objMapMode);
+}
+
+void agb_renderer_readback_rgba(AgbRenderer* r, uint32_t* dstRGBA, size_t pixelCount) {
+    r->ops->readback_rgba(r->impl, dstRGBA, pixelCount);
+}
+
+void agb_renderer_render_batch(AgbRenderer* r, const AgbHwState* states, size_t n, uint32_t* outRGBA) {
+    r->ops->render_batch(r->impl, states, n, outRGBA);
+}
+
+AgbHwState* agb_renderer_map_state(AgbRenderer* r) {
+    return r->ops->map_state ? r->ops->map_state(r->impl) : nullptr;
+}
+
+void agb_renderer_readback_rect(AgbRenderer* r, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride) {
+    if (r->ops->readback_rect) r->ops->readback_rect(r->impl, x, y, w, h, dst, dstStride);
+}
+
+int agb_renderer_acquire_frame(AgbRenderer* r, const uint32_t** pixels, size_t* stride) {
+    return r->ops->acquire_frame ? r->ops->acquire_frame(r->impl, pixels, stride) : 0;
+}
+
+void agb_renderer_release_frame(AgbRenderer* r) {
+    if (r->ops->release_frame) r->ops->release_frame(r->impl);
+}
+
+} // extern "C"
@@ -0,0 +1,111 @@
+// bridge/agb_renderer.h   Renderer-neutral front end over the compositor backends
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct AgbHwState AgbHwState;        // renderer/src/agb_hw_state.h
+typedef struct AgbVkCtx AgbVkCtx;            // renderer/src/agb_vk.h
+typedef struct AgbRenderer AgbRenderer;      // Opaque: a backend plus its context
+
+// Renderer inputs: the sections of AgbHwState the host uploads separately.
+typedef enum AgbInput {
+    AGB_INPUT_VRAM,
+    AGB_INPUT_PAL_BG,
+    AGB_INPUT_BG_PARAMS,
+    AGB_INPUT_PAL_OBJ,
+    AGB_INPUT_OAM,
+    AGB_INPUT_WIN,
+    AGB_INPUT_FX,
+    AGB_INPUT_SCANLINE,
+    AGB_INPUT_BG_AFF,
+    AGB_INPUT_OBJ_AFF,
+    AGB_INPUT_COUNT
+} AgbInput;
+
+// Backend entry points; `impl` is whatever create returned.
+// upload writes `countBytes` bytes at byte `offset` of an input, in the
+// layout of the matching agbvk_upload_* call. Offsets may be nonzero for
+// VRAM, palettes, OAM and scanlines; register blocks are written whole.
+typedef struct AgbRendererOps {
+    const char* name;
+    void* (*create)(void);                   // NULL on failure
+    void  (*destroy)(void* impl);
+    void  (*upload)(void* impl, AgbInput input, size_t offset, const void* bytes, size_t countBytes);
+    void  (*dispatch_frame)(void* impl, uint32_t fbW, uint32_t fbH,
+        uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode);
+    void  (*readback_rgba)(void* impl, uint32_t* dstRGBA, size_t pixelCount);
+    void  (*render_batch)(void* impl, const AgbHwState* states, size_t n, uint32_t* outRGBA);
+    // The backend's own copy of the state, written in place instead of
+    // uploaded (see agbvk_map_state / agbcpu_map_state); write every field.
+    // May be NULL for backends without one.
+    AgbHwState* (*map_state)(void* impl);
+    // The latest frame's framebuffer in the backend's memory, rows `stride`
+    // pixels apart (see agbvk_acquire_frame); 0 if there is none yet. Both
+    // may be NULL.
+    int   (*acquire_frame)(void* impl, const uint32_t** pixels, size_t* stride);
+    void  (*release_frame)(void* impl);
+    // Rectangle of the latest frame, see agbvk_readback_rect. May be NULL.
+    void  (*readback_rect)(void* impl, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+        uint32_t* dst, size_t dstStride);
+} AgbRendererOps;
+
+extern const AgbRendererOps agb_renderer_vulkan;   // agb_vk (compose_frame.comp)
+extern const AgbRendererOps agb_renderer_cpu;      // agb_cpu, same output on the CPU
+extern const AgbRendererOps agb_renderer_null;     // draws nothing: readbacks are all zero
+
+// Environment override for AGB_RENDERER_AUTO: "vulkan", "cpu" or "null".
+#define AGB_RENDERER_ENV "AGB_RENDERER"
+
+typedef enum AgbRendererKind {
+    AGB_RENDERER_AUTO,     // $AGB_RENDERER if set, else Vulkan with the CPU as fallback
+    AGB_RENDERER_VULKAN,
+    AGB_RENDERER_CPU,
+    AGB_RENDERER_NULL,
+} AgbRendererKind;
+
+// ---- Lifecycle ----
+// NULL if the backend could not be created.
+AgbRenderer* agb_renderer_create(AgbRendererKind kind);
+AgbRenderer* agb_renderer_create_with_ops(const AgbRendererOps* ops);
+void         agb_renderer_destroy(AgbRenderer* r);
+
+const char*  agb_renderer_name(const AgbRenderer* r);
+const AgbRendererOps* agb_renderer_ops(const AgbRenderer* r);
+void*        agb_renderer_impl(AgbRenderer* r);
+// The Vulkan context behind `r` (for sessions and pipelined submits), or NULL.
+AgbVkCtx*    agb_renderer_vk(AgbRenderer* r);
+
+// ---- Frame ----
+void agb_renderer_upload(AgbRenderer* r, AgbInput input, size_t offset, const void* bytes, size_t countBytes);
+void agb_renderer_dispatch_frame(AgbRenderer* r, uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode);
+void agb_renderer_readback_rgba(AgbRenderer* r, uint32_t* dstRGBA, size_t pixelCount);
+// The w x h rectangle at (x, y), clipped to the framebuffer; dst rows are
+// dstStride pixels apart. Writes nothing if the backend has no readback_rect.
+void agb_renderer_readback_rect(AgbRenderer* r, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride);
+void agb_renderer_render_batch(AgbRenderer* r, const AgbHwState* states, size_t n, uint32_t* outRGBA);
+
+// ---- Zero-copy state ----
+// State for the next dispatch in the backend's memory (GPU-visible staging on
+// Vulkan): fill it, e.g. gba::snapshot_to(*agb_renderer_map_state(r)), then
+// dispatch without a sync call. NULL if the backend has no such state.
+AgbHwState* agb_renderer_map_state(AgbRenderer* r);
+
+// ---- Zero-copy readback ----
+// The latest dispatched frame in place, instead of a readback copy: valid
+// until the backend reuses that memory (the next dispatch on the CPU,
+// framesInFlight submits later on Vulkan). 1 = acquired; 0 if the backend has
+// no such access or nothing was dispatched yet (fall back to readback_rgba).
+int  agb_renderer_acquire_frame(AgbRenderer* r, const uint32_t** pixels, size_t* stride);
+void agb_renderer_release_frame(AgbRenderer* r);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,245 @@
+#include "agb_scene.h"
+#include "agb_bridge.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// --- small helpers (host-side, Vulkan-free) ---------------------------------
+
+static inline void put16LE(uint8_t* dstBytes, size_t byteOffset, uint16_t v) {
+    dstBytes[byteOffset + 0] = static_cast<uint8_t>(v & 0xFF);
+    dstBytes[byteOffset + 1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+}
+
+static inline int32_t fx8(double f) {
+    return static_cast<int32_t>(std::lround(f * 256.0));
+}
+
+// splitmix32: fixed arithmetic, so a seed yields the same scene everywhere
+// (unlike the <random> distributions).
+struct SceneRng {
+    uint32_t s;
+    uint32_t next() {
+        uint32_t z = (s += 0x9E3779B9u);
+        z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+        return z ^ (z >> 16);
+    }
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>((uint64_t(next()) * n) >> 32); }
+    int32_t  range(int32_t lo, int32_t hi) { return lo + static_cast<int32_t>(below(uint32_t(hi - lo + 1))); }
+};
+
+// One independent stream per part of the state, so agb_scene_animate can
+// replay a part without regenerating the others.
+enum SceneStream : uint32_t { ST_VRAM = 1, ST_PAL, ST_BG, ST_OBJ, ST_AFF, ST_WIN, ST_SCAN };
+
+static SceneRng stream(const AgbSceneParams* p, SceneStream part) {
+    SceneRng r{ p->seed * 0x2545F491u ^ uint32_t(part) * 0x9E3779B9u };
+    r.next();
+    return r;
+}
+
+// VRAM layout, as in agb_init_hw: BG char blocks every 8 KB from 0, OBJ tiles
+// from AGB_SCENE_OBJ_CHAR_BASE, screen blocks every 8 KB from 64 KB.
+static const uint32_t SCENE_CHAR_BASE[4]   = { 0u, 8u * 1024u, 16u * 1024u, 24u * 1024u };
+static const uint32_t SCENE_SCREEN_BASE[4] = { 64u * 1024u, 72u * 1024u, 80u * 1024u, 88u * 1024u };
+static const uint32_t SCENE_MAP_DIM        = AGB_SCENE_MAP_DIM;
+static const uint32_t SCENE_OBJ_TILES      = 512u;  // first tile of an OBJ stays below this
+
+static bool bgIsAffine(const AgbSceneParams* p, uint32_t bg) {
+    return bg >= 2 && ((p->bgAffineMask >> bg) & 1u);
+}
+
+static uint32_t objTotal(const AgbSceneParams* p) {
+    const uint32_t vis = std::min(p->objCount, 128u);
+    const uint32_t win = (p->windowMask & 4u) ? std::min(p->objWindowCount, 128u - vis) : 0u;
+    return vis + win;
+}
+
+// ---------------------------------------------------------------------------
+
+void agb_scene_worst_case(AgbSceneParams* p, uint32_t seed) {
+    if (!p) return;
+    std::memset(p, 0, sizeof(*p));
+    p->seed = seed;
+    p->objCount = 120;
+    p->objWindowCount = 8;
+    p->objSize = 3;
+    p->objAffine = 1;
+    p->objDoubleSize = 1;
+    p->obj8bppPercent = 50;
+    p->objSemiTransparent = 1;
+    p->objMosaic = 1;
+    p->bgMask = 0xF;
+    p->bgAffineMask = 0xC;
+    p->bgMosaicMask = 0xF;
+    p->mosaicSize = 4;
+    p->windowMask = 7;
+    p->blendMode = 1;
+    p->scanlineOverrides = 1;
+}
+
+void agb_scene_generate(AgbHwState* hw, const AgbSceneParams* p) {
+    if (!hw || !p) return;
+
+    std::memset(hw, 0, sizeof(*hw));
+
+    // --- VRAM: random tile pixels everywhere, then the BG maps --------------
+    {
+        SceneRng r = stream(p, ST_VRAM);
+        for (uint32_t off = 0; off < SCENE_SCREEN_BASE[0]; off += 4) {
+            const uint32_t v = r.next();
+            std::memcpy(hw->vram + off, &v, 4);
+        }
+        for (uint32_t bg = 0; bg < AGB_BG_COUNT; ++bg) {
+            uint8_t* map = hw->vram + SCENE_SCREEN_BASE[bg];
+            for (uint32_t e = 0; e < SCENE_MAP_DIM * SCENE_MAP_DIM; ++e) {
+                if (bgIsAffine(p, bg)) {
+                    map[e] = static_cast<uint8_t>(r.below(128));   // 8bpp tiles of an 8 KB block
+                } else {
+                    const uint32_t tile = r.below(256), flips = r.below(4), bank = r.below(16);
+                    put16LE(map, 2u * e, static_cast<uint16_t>(tile | (flips << 10) | (bank << 12)));
+                }
+            }
+        }
+    }
+
+    // --- Palettes: random BGR555, backdrop included -------------------------
+    {
+        SceneRng r = stream(p, ST_PAL);
+        for (uint32_t i = 0; i < AGB_PAL_BG_SIZE / 2; ++i) put16LE(hw->pal_bg, i * 2, static_cast<uint16_t>(r.below(0x8000)));
+        for (uint32_t i = 0; i < AGB_PAL_OBJ_SIZE / 2; ++i) put16LE(hw->pal_obj, i * 2, static_cast<uint16_t>(r.below(0x8000)));
+    }
+
+    // --- BG params (scroll is set by agb_scene_animate) ---------------------
+    {
+        SceneRng r = stream(p, ST_BG);
+        for (uint32_t bg = 0; bg < AGB_BG_COUNT; ++bg) {
+            uint32_t flags = 0;
+            if (bgIsAffine(p, bg)) flags |= AGB_BG_FLAG_AFFINE | AGB_BG_FLAG_WRAP;
+            if ((p->bgMosaicMask >> bg) & 1u) flags |= AGB_BG_FLAG_MOSAIC;
+            hw->bg_params[bg] = { SCENE_CHAR_BASE[bg], SCENE_SCREEN_BASE[bg], 0, 0,
+                r.below(4), (p->bgMask >> bg) & 1u, flags, 0 };
+        }
+    }
+
+    // --- Windows: WIN0 and WIN1 overlap mid-screen ---------------------------
+    // With any window on, the four masks differ and each hides something, so
+    // every pixel runs the full window evaluation (a mask showing everything
+    // everywhere lets the compositor skip it).
+    {
+        SceneRng r = stream(p, ST_WIN);
+        const uint32_t all = 0x3Fu;   // BG0..BG3, OBJ, ColorEffect
+        auto rect = [&](uint32_t* w) {
+            w[0] = r.below(100); w[1] = r.below(60);
+            w[2] = w[0] + 60 + r.below(80); w[3] = w[1] + 40 + r.below(60);
+        };
+        if (p->windowMask & 1u) rect(hw->win.win0);
+        if (p->windowMask & 2u) rect(hw->win.win1);
+        const bool windows = (p->windowMask & 7u) != 0;
+        hw->win.winIn0 = windows ? all & ~0x01u : all;          // no BG0
+        hw->win.winIn1 = windows ? all & ~0x02u : all;          // no BG1
+        hw->win.winOut = windows ? all & ~(0x08u | 0x20u) : all; // no BG3, no color effect
+        hw->win.winObj = windows ? all & ~(0x04u | 0x10u) : all; // no BG2, no OBJ
+    }
+
+    // --- Color math & mosaic -------------------------------------------------
+    const uint32_t targets = 0x3Fu;   // BG0..BG3, OBJ, backdrop
+    const uint32_t bldcnt = p->blendMode ? (targets | ((p->blendMode & 3u) << 6) | (targets << 8)) : 0u;
+    {
+        const uint32_t m = std::min(std::max(p->mosaicSize, 1u), 16u) - 1u;
+        hw->fx.bldcnt = bldcnt;
+        hw->fx.bldalpha = 10u | (6u << 8);
+        hw->fx.bldy = 8u;
+        hw->fx.mosaic = m | (m << 4) | (m << 8) | (m << 12);
+    }
+
+    // --- Per-scanline overrides: distinct values on every line -------------
+    if (p->scanlineOverrides) {
+        SceneRng r = stream(p, ST_SCAN);
+        for (uint32_t y = 0; y < AGB_SCANLINES; ++y) {
+            Scanline& s = hw->scan[y];
+            for (uint32_t bg = 0; bg < AGB_BG_COUNT; ++bg) {
+                s.hofs[bg] = r.below(512);
+                s.vofs[bg] = r.below(256);
+            }
+            s.win0x1 = r.below(120); s.win0x2 = s.win0x1 + 1 + r.below(120);
+            s.win1x1 = hw->win.win1[0]; s.win1x2 = hw->win.win1[2];
+            s.bldcnt = bldcnt;
+            s.bldalpha = r.below(17) | (r.below(17) << 8);
+            s.bldy = r.below(17);
+            s.flags = 1u;
+        }
+    }
+
+    // --- OAM: hide everything, then place OBJs at frame 0 -------------------
+    for (uint32_t i = 0; i < 128; ++i) put16LE(hw->oam, i * 8, 0x0200);
+    agb_scene_animate(hw, p, 0);
+}
+
+void agb_scene_animate(AgbHwState* hw, const AgbSceneParams* p, uint32_t frame) {
+    if (!hw || !p) return;
+
+    // --- BG scroll and affine matrices --------------------------------------
+    {
+        SceneRng r = stream(p, ST_AFF);
+        for (uint32_t bg = 0; bg < AGB_BG_COUNT; ++bg) {
+            const uint32_t h0 = r.below(512), v0 = r.below(512);
+            const int32_t dh = r.range(-3, 3), dv = r.range(-3, 3);
+            hw->bg_params[bg].hofs = (h0 + uint32_t(dh) * frame) & 0x1FFu;
+            hw->bg_params[bg].vofs = (v0 + uint32_t(dv) * frame) & 0x1FFu;
+
+            const double a = double(r.below(360)) + double(r.range(-2, 2)) * frame;
+            const double scale = 0.5 + double(r.below(101)) / 100.0;
+            if (!bgIsAffine(p, bg)) continue;
+            const double rad = a * 3.14159265358979323846 / 180.0;
+            const int32_t pa = fx8(std::cos(rad) * scale), pb = fx8(-std::sin(rad) * scale);
+            const int32_t pc = fx8(std::sin(rad) * scale), pd = fx8(std::cos(rad) * scale);
+            const int32_t u0 = int32_t(SCENE_MAP_DIM * 8 / 2), v0c = int32_t(SCENE_MAP_DIM * 8 / 2);
+            hw->bgAff[bg] = { (u0 << 8) - pa * 120 - pb * 80, (v0c << 8) - pc * 120 - pd * 80, pa, pb, pc, pd };
+        }
+        for (uint32_t k = 0; k < AGB_OBJ_AFF_COUNT; ++k) {
+            const double a = double(r.below(360)) + double(r.range(-4, 4)) * frame;
+            const double scale = 0.75 + double(r.below(76)) / 100.0;
+            const double rad = a * 3.14159265358979323846 / 180.0;
+            hw->objAff[k] = { fx8(std::cos(rad) / scale), fx8(-std::sin(rad) / scale),
+                              fx8(std::sin(rad) / scale), fx8(std::cos(rad) / scale) };
+        }
+    }
+
+    // --- OBJs: drift across the screen, wrapping at the edges ---------------
+    {
+        SceneRng r = stream(p, ST_OBJ);
+        const uint32_t vis = std::min(p->objCount, 128u);
+        const uint32_t n = objTotal(p);
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t size = p->objSize < 4 ? p->objSize : r.below(4);
+            const uint32_t dim = 8u << size;
+            const bool is8 = r.below(100) < p->obj8bppPercent;
+            const uint32_t cx0 = r.below(240), cy0 = r.below(160);
+            const int32_t dx = r.range(-3, 3), dy = r.range(-3, 3);
+            const uint32_t tile = r.below(SCENE_OBJ_TILES) & (is8 ? ~1u : ~0u);
+            const uint32_t pri = r.below(4), bank = r.below(16), aff = r.below(AGB_OBJ_AFF_COUNT);
+
+            const uint32_t cx = uint32_t(((int64_t(cx0) + int64_t(dx) * frame) % 240 + 240) % 240);
+            const uint32_t cy = uint32_t(((int64_t(cy0) + int64_t(dy) * frame) % 160 + 160) % 160);
+            const uint32_t x = (cx + 512u - dim / 2) & 0x1FFu;
+            const uint32_t y = (cy + 256u - dim / 2) & 0xFFu;
+
+            const uint32_t mode = (i >= vis) ? 2u : (p->objSemiTransparent ? 1u : 0u);
+            uint32_t attr0 = y | (mode << 10) | (is8 ? (1u << 13) : 0u) | /*square*/0u;
+            uint32_t attr1 = x | (size << 14);
+            if (p->objAffine) {
+                attr0 |= (1u << 8) | (p->objDoubleSize ? (1u << 9) : 0u);
+                attr1 |= aff << 9;
+            }
+            if (p->objMosaic) attr0 |= 1u << 12;
+            const uint32_t attr2 = tile | (pri << 10) | (bank << 12);
+
+            put16LE(hw->oam, i * 8 + 0, static_cast<uint16_t>(attr0));
+            put16LE(hw->oam, i * 8 + 2, static_cast<uint16_t>(attr1));
+            put16LE(hw->oam, i * 8 + 4, static_cast<uint16_t>(attr2));
+        }
+    }
+}
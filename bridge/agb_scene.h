@@ -0,0 +1,69 @@
+// bridge/agb_scene.h   Parameterized scene generator (stress and sizing inputs)
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct AgbHwState AgbHwState;        // renderer/src/agb_hw_state.h
+
+// Dispatch generated scenes with mapW = mapH = AGB_SCENE_MAP_DIM and
+// objCharBase = AGB_SCENE_OBJ_CHAR_BASE (the demo scene's values).
+#define AGB_SCENE_MAP_DIM        (32u)
+#define AGB_SCENE_OBJ_CHAR_BASE  (32u * 1024u)
+
+// Every random choice (tile pixels, maps, palettes, OBJ placement, affine
+// matrices, per-line values) comes from `seed`, so a parameter set plus a
+// seed always reproduces the same state.
+typedef struct AgbSceneParams {
+    uint32_t seed;
+
+    // OBJs. OAM has 128 entries: visible OBJs come first, OBJ-window OBJs
+    // after them, and the total is clamped to 128. Window OBJs go through the
+    // same per-pixel tests as visible ones, so they cost the same.
+    uint32_t objCount;           // visible OBJs
+    uint32_t objWindowCount;     // OBJ-window OBJs (used when windowMask has bit 2)
+    uint32_t objSize;            // 0..3 = 8/16/32/64 px squares, 4 = random per OBJ
+    uint32_t objAffine;          // nonzero: every OBJ uses one of the 32 affine sets
+    uint32_t objDoubleSize;      // nonzero: affine OBJs are double-size
+    uint32_t obj8bppPercent;     // share of 8bpp OBJs, 0..100
+    uint32_t objSemiTransparent; // nonzero: visible OBJs are semi-transparent
+    uint32_t objMosaic;          // nonzero: OBJs use mosaic
+
+    // BGs (bit n = BGn). Affine BGs wrap; the compositor samples BG2 as affine.
+    uint32_t bgMask;             // enabled BGs
+    uint32_t bgAffineMask;       // BGs flagged AFFINE | WRAP (BG2/BG3 only)
+    uint32_t bgMosaicMask;       // BGs with mosaic
+    uint32_t mosaicSize;         // mosaic block, 1..16 px, BG and OBJ, both axes
+
+    // Windows and color math
+    uint32_t windowMask;         // bit 0 = WIN0, bit 1 = WIN1, bit 2 = OBJ window; when nonzero,
+                                 // WIN0/WIN1/outside/OBJ-window each hide a different layer
+    uint32_t blendMode;          // BLDCNT mode: 0 none, 1 alpha, 2 brighten, 3 darken,
+                                 // with every layer as first and second target
+    uint32_t scanlineOverrides;  // nonzero: distinct scroll, WIN0 X and blend on all 160 lines
+} AgbSceneParams;
+
+// Fill `p` with the heaviest setting of every parameter: 120 visible 64x64
+// affine double-size OBJs (half 8bpp, semi-transparent, mosaic) plus 8
+// OBJ-window OBJs, all four BGs with BG2/BG3 affine-wrap and mosaic on all,
+// both windows and the OBJ window, alpha blending on every layer, and
+// per-line overrides on every scanline.
+void agb_scene_worst_case(AgbSceneParams* p, uint32_t seed);
+
+// Build a complete state for `p` (VRAM, palettes, maps, OAM, registers,
+// scanlines, affine sets) at frame 0.
+void agb_scene_generate(AgbHwState* hw, const AgbSceneParams* p);
+
+// Move the scene of `hw` (built by agb_scene_generate with the same `p`) to
+// `frame`: OBJ positions, BG scroll and affine matrices. Touches only OAM,
+// BG params and the affine sets, so incremental syncs stay small.
+void agb_scene_animate(AgbHwState* hw, const AgbSceneParams* p, uint32_t frame);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,30 @@
+# Turn a SPIR-V binary into a C++ source defining it as a byte array.
+# Usage: cmake -DINPUT=<file.spv> -DOUTPUT=<file.cpp> -DSYMBOL=<name> -P embed_spirv.cmake
+
+if(NOT INPUT OR NOT OUTPUT OR NOT SYMBOL)
+  message(FATAL_ERROR "embed_spirv.cmake needs INPUT, OUTPUT and SYMBOL")
+endif()
+
+file(READ "${INPUT}" _hex HEX)
+string(LENGTH "${_hex}" _hex_len)
+math(EXPR _size "${_hex_len} / 2")
+
+# 16 bytes per line
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," _bytes "${_hex}")
+string(REPEAT "0x[0-9a-f][0-9a-f]," 16 _line)
+string(REGEX REPLACE "(${_line})" "\\1\n    " _bytes "${_bytes}")
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated by renderer/cmake/embed_spirv.cmake from ${INPUT}. Do not edit.
+#include <cstddef>
+
+extern \"C\" {
+alignas(4) extern const unsigned char ${SYMBOL}[] = {
+    ${_bytes}
+};
+extern const size_t ${SYMBOL}_size = ${_size};
+}
+")
+# Only touch OUTPUT when the contents change, so agb_vk doesn't rebuild needlessly.
+file(COPY_FILE "${OUTPUT}.tmp" "${OUTPUT}" ONLY_IF_DIFFERENT)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,41 @@
+// renderer/shaders/agb_state_layout.h   AgbHwState layout shared by the shaders and agb_vk
+//
+// Plain #defines so the same file is valid GLSL (compose_frame.comp,
+// obj_bin.comp, pal_lut.comp) and C/C++ (agb_vk.cpp static_asserts every
+// value against AgbHwState, renderer/src/agb_hw_state.h). The state buffer holds one AgbHwState per layer,
+// AGB_STATE_WORDS apart; offsets are in 32-bit words from the layer start.
+
+#ifndef AGB_STATE_LAYOUT_H
+#define AGB_STATE_LAYOUT_H
+
+// Byte storages, packed 4 per word (little-endian)
+#define AGB_STATE_VRAM        0u        // 96 KB
+#define AGB_STATE_PAL_BG      24576u    // 1 KB, 512 BGR555 entries
+#define AGB_STATE_PAL_OBJ     24832u    // 512 B, 256 BGR555 entries
+#define AGB_STATE_OAM         24960u    // 1 KB, 128 entries of 8 bytes
+
+// Registers / structured state
+#define AGB_STATE_BG_PARAMS   25216u    // 4 BGParam
+#define AGB_STATE_WIN         25248u    // WinState
+#define AGB_STATE_FX          25260u    // FxRegs
+#define AGB_STATE_SCAN        25264u    // 160 Scanline
+#define AGB_STATE_BG_AFF      28464u    // 4 AffineParam
+#define AGB_STATE_OBJ_AFF     28488u    // 32 ObjAff
+
+#define AGB_STATE_WORDS       28616u    // sizeof(AgbHwState) / 4
+
+// VRAM reads at or past this byte offset return 0 (as in agb_cpu) instead of
+// running into the palettes and OAM that follow it in the same state.
+#define AGB_STATE_VRAM_BYTES  98304u
+
+// Scanline records; framebuffer lines from here on reuse the last record.
+#define AGB_STATE_SCANLINES   160u
+
+// Words per array element
+#define AGB_STATE_BG_PARAM_WORDS  8u
+#define AGB_STATE_WIN_WORDS       12u
+#define AGB_STATE_SCAN_WORDS      20u
+#define AGB_STATE_BG_AFF_WORDS    6u
+#define AGB_STATE_OBJ_AFF_WORDS   4u
+
+#endif // AGB_STATE_LAYOUT_H
@@ -0,0 +1,624 @@
+#include "agb_cpu.h"
+#include "agb_hw_state.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define AGBCPU_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define AGBCPU_TARGET(isa)
+#  else
+#    define AGBCPU_TARGET(isa) __attribute__((target(isa)))
+#  endif
+#endif
+
+// Everything here mirrors compose_frame.comp (and its obj_bin/pal_lut
+// prepasses) operation for operation, including the integer wrap-arounds and
+// the unmasked RGBA8 packing, so both backends produce the same bytes.
+
+// Palette LUT (as written by pal_lut.comp): 512 BG then 256 OBJ colors.
+static constexpr uint32_t LUT_ENTRIES = 768;
+static constexpr uint32_t LUT_OBJ = 512;
+
+static constexpr uint32_t LINES_PER_TASK = 8;
+static constexpr std::array<uint32_t, 6> DEFAULT_PC = { 240, 160, 32, 32, 32 * 1024, 0 };
+
+// ---- Input readers ----------------------------------------------------------
+// Same alignment rules and bounds as the shader's read*_vram: reads past VRAM
+// return 0 on both backends.
+static inline uint32_t vram8(const uint8_t* v, uint32_t off) { return off < AGB_VRAM_SIZE ? v[off] : 0u; }
+static inline uint32_t vram16(const uint8_t* v, uint32_t off) {
+    off &= ~1u;
+    return off < AGB_VRAM_SIZE ? uint32_t(v[off]) | (uint32_t(v[off + 1]) << 8) : 0u;
+}
+static inline uint32_t vram32(const uint8_t* v, uint32_t off) {
+    off &= ~3u;
+    if (off >= AGB_VRAM_SIZE) return 0u;
+    uint32_t w;
+    std::memcpy(&w, v + off, sizeof(w));   // little-endian host, like the GPU upload
+    return w;
+}
+static inline uint32_t oam16(const uint8_t* oam, uint32_t off) { return uint32_t(oam[off]) | (uint32_t(oam[off + 1]) << 8); }
+
+// GLSL int math wraps; do it in uint32_t and convert back.
+static inline int32_t wrap_i32(uint32_t v) { return int32_t(v); }
+
+static uint32_t bgr555_to_rgba8(uint32_t bgr) {
+    const uint32_t r = ( bgr        & 31u) * 255u / 31u;
+    const uint32_t g = ((bgr >> 5)  & 31u) * 255u / 31u;
+    const uint32_t b = ((bgr >> 10) & 31u) * 255u / 31u;
+    return (255u << 24) | (b << 16) | (g << 8) | r;
+}
+
+static void expand_palettes(const AgbHwState& s, uint32_t* lut) {
+    for (uint32_t e = 0; e < AGB_PAL_BG_SIZE / 2; ++e)
+        lut[e] = bgr555_to_rgba8(s.pal_bg[2 * e] | (uint32_t(s.pal_bg[2 * e + 1]) << 8));
+    for (uint32_t e = 0; e < AGB_PAL_OBJ_SIZE / 2; ++e)
+        lut[LUT_OBJ + e] = bgr555_to_rgba8(s.pal_obj[2 * e] | (uint32_t(s.pal_obj[2 * e + 1]) << 8));
+}
+
+// ---- Color resolve kernels ----------------------------------------------------
+// Per pixel: LUT entries of the top and second layer and the color op to apply.
+enum : uint8_t { OP_COPY, OP_ALPHA, OP_BRIGHTEN, OP_DARKEN };
+
+using ResolveFn = void (*)(const uint32_t* lut, const uint16_t* top, const uint16_t* second, const uint8_t* op,
+    uint32_t n, uint32_t eva, uint32_t evb, uint32_t yv, uint32_t* out);
+
+static inline uint32_t resolve_pixel(uint32_t a, uint32_t b, uint32_t op, uint32_t eva, uint32_t evb, uint32_t yv) {
+    if (op == OP_COPY) return a;
+    uint32_t res = 255u << 24;
+    for (uint32_t sh = 0; sh < 24; sh += 8) {
+        const uint32_t ca = (a >> sh) & 0xFFu, cb = (b >> sh) & 0xFFu;
+        const uint32_t v = (op == OP_ALPHA) ? (eva * ca + evb * cb) / 16u
+                         : (op == OP_BRIGHTEN) ? ca + ((255u - ca) * yv) / 16u
+                         : ca - (ca * yv) / 16u;
+        res |= v << sh;   // unmasked like pack_rgba8: an alpha sum > 255 spills into the next channel
+    }
+    return res;
+}
+
+static void resolve_scalar(const uint32_t* lut, const uint16_t* top, const uint16_t* second, const uint8_t* op,
+    uint32_t n, uint32_t eva, uint32_t evb, uint32_t yv, uint32_t* out) {
+    for (uint32_t x = 0; x < n; ++x)
+        out[x] = resolve_pixel(lut[top[x]], lut[second[x]], op[x], eva, evb, yv);
+}
+
+#if defined(AGBCPU_X86)
+// Channel values stay below 2^16, so 16-bit multiplies on 32-bit lanes are exact.
+AGBCPU_TARGET("sse4.1")
+static void resolve_sse41(const uint32_t* lut, const uint16_t* top, const uint16_t* second, const uint8_t* op,
+    uint32_t n, uint32_t eva, uint32_t evb, uint32_t yv, uint32_t* out) {
+    const __m128i ff = _mm_set1_epi32(0xFF), full = _mm_set1_epi32(255);
+    const __m128i alpha = _mm_set1_epi32(int(0xFF000000u));
+    const __m128i vEva = _mm_set1_epi32(int(eva)), vEvb = _mm_set1_epi32(int(evb)), vY = _mm_set1_epi32(int(yv));
+    uint32_t x = 0;
+    for (; x + 4 <= n; x += 4) {
+        const __m128i a = _mm_setr_epi32(int(lut[top[x]]), int(lut[top[x + 1]]), int(lut[top[x + 2]]), int(lut[top[x + 3]]));
+        const __m128i b = _mm_setr_epi32(int(lut[second[x]]), int(lut[second[x + 1]]), int(lut[second[x + 2]]), int(lut[second[x + 3]]));
+        int ops4;
+        std::memcpy(&ops4, op + x, sizeof(ops4));
+        const __m128i ops = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(ops4));
+
+        __m128i rA = alpha, rB = alpha, rD = alpha;
+        for (int sh = 0; sh < 24; sh += 8) {
+            const __m128i cnt = _mm_cvtsi32_si128(sh);
+            const __m128i ca = _mm_and_si128(_mm_srl_epi32(a, cnt), ff);
+            const __m128i cb = _mm_and_si128(_mm_srl_epi32(b, cnt), ff);
+            const __m128i al = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi16(ca, vEva), _mm_mullo_epi16(cb, vEvb)), 4);
+            const __m128i br = _mm_add_epi32(ca, _mm_srli_epi32(_mm_mullo_epi16(_mm_sub_epi32(full, ca), vY), 4));
+            const __m128i dk = _mm_sub_epi32(ca, _mm_srli_epi32(_mm_mullo_epi16(ca, vY), 4));
+            rA = _mm_or_si128(rA, _mm_sll_epi32(al, cnt));
+            rB = _mm_or_si128(rB, _mm_sll_epi32(br, cnt));
+            rD = _mm_or_si128(rD, _mm_sll_epi32(dk, cnt));
+        }
+        __m128i res = a;
+        res = _mm_blendv_epi8(res, rA, _mm_cmpeq_epi32(ops, _mm_set1_epi32(OP_ALPHA)));
+        res = _mm_blendv_epi8(res, rB, _mm_cmpeq_epi32(ops, _mm_set1_epi32(OP_BRIGHTEN)));
+        res = _mm_blendv_epi8(res, rD, _mm_cmpeq_epi32(ops, _mm_set1_epi32(OP_DARKEN)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), res);
+    }
+    resolve_scalar(lut, top + x, second + x, op + x, n - x, eva, evb, yv, out + x);
+}
+
+AGBCPU_TARGET("avx2")
+static void resolve_avx2(const uint32_t* lut, const uint16_t* top, const uint16_t* second, const uint8_t* op,
+    uint32_t n, uint32_t eva, uint32_t evb, uint32_t yv, uint32_t* out) {
+    const __m256i ff = _mm256_set1_epi32(0xFF), full = _mm256_set1_epi32(255);
+    const __m256i alpha = _mm256_set1_epi32(int(0xFF000000u));
+    const __m256i vEva = _mm256_set1_epi32(int(eva)), vEvb = _mm256_set1_epi32(int(evb)), vY = _mm256_set1_epi32(int(yv));
+    const int* lutI = reinterpret_cast<const int*>(lut);
+    uint32_t x = 0;
+    for (; x + 8 <= n; x += 8) {
+        const __m256i it = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x)));
+        const __m256i is = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(second + x)));
+        const __m256i ops = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(op + x)));
+        const __m256i a = _mm256_i32gather_epi32(lutI, it, 4);
+        const __m256i b = _mm256_i32gather_epi32(lutI, is, 4);
+
+        __m256i rA = alpha, rB = alpha, rD = alpha;
+        for (int sh = 0; sh < 24; sh += 8) {
+            const __m128i cnt = _mm_cvtsi32_si128(sh);
+            const __m256i ca = _mm256_and_si256(_mm256_srl_epi32(a, cnt), ff);
+            const __m256i cb = _mm256_and_si256(_mm256_srl_epi32(b, cnt), ff);
+            const __m256i al = _mm256_srli_epi32(_mm256_add_epi32(_mm256_mullo_epi16(ca, vEva), _mm256_mullo_epi16(cb, vEvb)), 4);
+            const __m256i br = _mm256_add_epi32(ca, _mm256_srli_epi32(_mm256_mullo_epi16(_mm256_sub_epi32(full, ca), vY), 4));
+            const __m256i dk = _mm256_sub_epi32(ca, _mm256_srli_epi32(_mm256_mullo_epi16(ca, vY), 4));
+            rA = _mm256_or_si256(rA, _mm256_sll_epi32(al, cnt));
+            rB = _mm256_or_si256(rB, _mm256_sll_epi32(br, cnt));
+            rD = _mm256_or_si256(rD, _mm256_sll_epi32(dk, cnt));
+        }
+        __m256i res = a;
+        res = _mm256_blendv_epi8(res, rA, _mm256_cmpeq_epi32(ops, _mm256_set1_epi32(OP_ALPHA)));
+        res = _mm256_blendv_epi8(res, rB, _mm256_cmpeq_epi32(ops, _mm256_set1_epi32(OP_BRIGHTEN)));
+        res = _mm256_blendv_epi8(res, rD, _mm256_cmpeq_epi32(ops, _mm256_set1_epi32(OP_DARKEN)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), res);
+    }
+    resolve_scalar(lut, top + x, second + x, op + x, n - x, eva, evb, yv, out + x);
+}
+#endif
+
+static ResolveFn pick_resolve(bool noSimd) {
+    if (noSimd) return resolve_scalar;
+#if defined(AGBCPU_X86)
+#  if defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    __cpuid(r, 0);
+    const int maxLeaf = r[0];
+    __cpuid(r, 1);
+    const bool sse41 = (r[2] >> 19) & 1, osxsave = (r[2] >> 27) & 1, avx = (r[2] >> 28) & 1;
+    if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(r, 7, 0);
+        if ((r[1] >> 5) & 1) return resolve_avx2;
+    }
+    if (sse41) return resolve_sse41;
+#  else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return resolve_avx2;
+    if (__builtin_cpu_supports("sse4.1")) return resolve_sse41;
+#  endif
+#endif
+    return resolve_scalar;
+}
+
+// ---- Worker pool --------------------------------------------------------------
+// Runs fn(task, worker) for every task of a job; the calling thread is worker 0
+// and takes part, so a pool of one thread has no workers at all.
+struct Pool {
+    using Job = std::function<void(uint32_t, uint32_t)>;
+
+    std::vector<std::thread> workers;
+    std::mutex               mtx;
+    std::condition_variable  wake, done;
+    const Job*               job = nullptr;
+    uint32_t                 jobTasks = 0;
+    std::atomic<uint32_t>    next{ 0 };
+    uint32_t                 busy = 0;       // workers still inside the current job
+    uint64_t                 generation = 0;
+    bool                     quit = false;
+
+    uint32_t size() const { return uint32_t(workers.size()) + 1; }
+
+    void start(uint32_t threads) {
+        for (uint32_t w = 1; w < threads; ++w) workers.emplace_back([this, w] { loop(w); });
+    }
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : workers) t.join();
+        workers.clear();
+    }
+    void drain(uint32_t worker) {
+        for (uint32_t t; (t = next.fetch_add(1)) < jobTasks; ) (*job)(t, worker);
+    }
+    void loop(uint32_t worker) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lk(mtx);
+        for (;;) {
+            wake.wait(lk, [&] { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+            lk.unlock();
+            drain(worker);
+            lk.lock();
+            if (--busy == 0) done.notify_one();
+        }
+    }
+    void run(uint32_t n, const Job& fn) {
+        if (workers.empty() || n <= 1) {
+            for (uint32_t t = 0; t < n; ++t) fn(t, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            job = &fn; jobTasks = n; next = 0;
+            busy = uint32_t(workers.size());
+            ++generation;
+        }
+        wake.notify_all();
+        drain(0);
+        std::unique_lock<std::mutex> lk(mtx);
+        done.wait(lk, [this] { return busy == 0; });
+        job = nullptr;
+    }
+};
+
+// ---- Scanline renderer ----------------------------------------------------------
+// One state plus the push constants, as the compose dispatch sees them.
+struct FrameIn {
+    const AgbHwState* s;
+    const uint32_t*   lut;
+    uint32_t fbW, fbH, mapW, mapH, objCharBase, objMapMode;
+};
+
+static FrameIn frame_in(const AgbHwState& s, const uint32_t* lut, const std::array<uint32_t, 6>& pc) {
+    // a zero map size is a division by zero on the GPU; treat it as 1
+    return { &s, lut, pc[0], pc[1], std::max(pc[2], 1u), std::max(pc[3], 1u), pc[4], pc[5] };
+}
+
+enum : uint8_t { OBJ_VALID = 1, OBJ_SEMI = 2, OBJ_WIN = 4 };
+
+// Per-worker line buffers. Layer lines hold LUT entries, 0 = transparent
+// (entry 0 is the backdrop, which no BG or OBJ texel can select).
+struct LineBuf {
+    std::vector<uint16_t> bg[AGB_BG_COUNT];
+    std::vector<uint16_t> obj;
+    std::vector<uint8_t>  objPri, objIdx, objFlags;
+    std::vector<uint16_t> top, second;
+    std::vector<uint8_t>  op;
+
+    void resize(uint32_t w) {
+        for (auto& l : bg) l.resize(w);
+        obj.resize(w); objPri.resize(w); objIdx.resize(w); objFlags.resize(w);
+        top.resize(w); second.resize(w); op.resize(w);
+    }
+};
+
+// Scanline record of line y: clamped to the framebuffer and then to the 160
+// records, the same rule as the shader's SCAN().
+static const Scanline& scan_at(const FrameIn& f, uint32_t y) {
+    return f.s->scan[std::min(std::min(y, f.fbH - 1), AGB_SCANLINES - 1)];
+}
+
+static void render_text_bg(const FrameIn& f, uint32_t id, uint32_t y, uint16_t* line) {
+    const uint8_t* v = f.s->vram;
+    const BGParam& P = f.s->bg_params[id];
+    const Scanline& sl = scan_at(f, y);
+    const uint32_t hofs = P.hofs + sl.hofs[id];
+    const uint32_t vofs = P.vofs + sl.vofs[id];
+    const bool mosaic = (P.flags & AGB_BG_FLAG_MOSAIC) != 0;
+    const uint32_t mx = (f.s->fx.mosaic & 0xFu) + 1u, my = ((f.s->fx.mosaic >> 4) & 0xFu) + 1u;
+
+    uint32_t py = (y + vofs) & 0xFFFFu;
+    if (mosaic) py = (py / my) * my;
+    const uint32_t ty = (py >> 3) % f.mapH;
+
+    uint32_t lastTx = UINT32_MAX, attr = 0, row = 0;
+    for (uint32_t x = 0; x < f.fbW; ++x) {
+        uint32_t px = (x + hofs) & 0xFFFFu;
+        if (mosaic) px = (px / mx) * mx;
+        const uint32_t tx = (px >> 3) % f.mapW;
+        if (tx != lastTx) {   // one map entry and tile row per 8 pixels
+            attr = vram16(v, P.screenBase + 2u * (ty * f.mapW + tx));
+            uint32_t r = py & 7u;
+            if (attr & (1u << 11)) r = 7u - r;
+            row = vram32(v, P.charBase + (attr & 0x03FFu) * 32u + r * 4u);
+            lastTx = tx;
+        }
+        uint32_t c = px & 7u;
+        if (attr & (1u << 10)) c = 7u - c;
+        const uint32_t nib = (row >> (c << 2)) & 0xFu;
+        line[x] = nib ? uint16_t(((attr >> 12) & 0xFu) * 16u + nib) : 0;
+    }
+}
+
+static void render_affine_bg(const FrameIn& f, uint32_t id, uint32_t y, uint16_t* line) {
+    const uint8_t* v = f.s->vram;
+    const BGParam& P = f.s->bg_params[id];
+    const AffineParam& M = f.s->bgAff[id];
+    const bool mosaic = (P.flags & AGB_BG_FLAG_MOSAIC) != 0;
+    const uint32_t mx = (f.s->fx.mosaic & 0xFu) + 1u, my = ((f.s->fx.mosaic >> 4) & 0xFu) + 1u;
+    const int32_t W = wrap_i32(f.mapW * 8u), H = wrap_i32(f.mapH * 8u);
+
+    for (uint32_t x = 0; x < f.fbW; ++x) {
+        int32_t u = wrap_i32(uint32_t(M.pa) * x + uint32_t(M.pb) * y + uint32_t(M.refX)) >> 8;
+        int32_t w = wrap_i32(uint32_t(M.pc) * x + uint32_t(M.pd) * y + uint32_t(M.refY)) >> 8;
+        line[x] = 0;
+        if (P.flags & AGB_BG_FLAG_WRAP) {
+            u = ((u % W) + W) % W;
+            w = ((w % H) + H) % H;
+        } else if (u < 0 || w < 0 || u >= W || w >= H) {
+            continue;
+        }
+        uint32_t ux = uint32_t(u), uy = uint32_t(w);
+        if (mosaic) { ux = (ux / mx) * mx; uy = (uy / my) * my; }
+
+        const uint32_t tx = (ux >> 3) % f.mapW, ty = (uy >> 3) % f.mapH;
+        const uint32_t tile = vram8(v, P.screenBase + ty * f.mapW + tx);
+        line[x] = uint16_t(vram8(v, P.charBase + tile * 64u + (uy & 7u) * 8u + (ux & 7u)));
+    }
+}
+
+// Front-most OBJ texel per pixel, by priority then OAM index, plus OBJ-window
+// coverage (sampleOBJ, iterated sprite by sprite instead of pixel by pixel).
+static void render_obj(const FrameIn& f, uint32_t y, LineBuf& L) {
+    std::fill(L.objFlags.begin(), L.objFlags.end(), uint8_t(0));
+    const uint8_t* v = f.s->vram;
+    const uint8_t* oam = f.s->oam;
+    const uint32_t mx = ((f.s->fx.mosaic >> 8) & 0xFu) + 1u, my = ((f.s->fx.mosaic >> 12) & 0xFu) + 1u;
+    const uint32_t tilesPerRow = (f.objMapMode == 1u) ? (f.fbW / 8u) : 32u;
+
+    for (uint32_t i = 0; i < 128; ++i) {
+        const uint32_t a0 = oam16(oam, i * 8u), a1 = oam16(oam, i * 8u + 2u), a2 = oam16(oam, i * 8u + 4u);
+        if (((a0 >> 8) & 3u) == 2u) continue;   // hidden
+
+        const uint32_t oy = a0 & 0x00FFu, ox = a1 & 0x01FFu;
+        const uint32_t dim = ((a0 >> 14) == 0u) ? (8u << (a1 >> 14)) : 8u;   // square only, like the shader
+        const uint32_t py = (y + 256u - oy) % 256u;
+        if (py >= dim) continue;
+
+        const bool affine = (a0 & (1u << 8)) != 0;
+        const bool objMosaic = (a0 & (1u << 12)) != 0;
+        const uint32_t objMode = (a0 >> 10) & 3u;
+        const bool is8 = (a0 & (1u << 13)) != 0;
+        const uint32_t tile = a2 & 0x03FFu, pri = (a2 >> 10) & 3u, palBank = (a2 >> 12) & 0xFu;
+        const ObjAff& T = f.s->objAff[(a1 >> 9) & 31u];
+        const int32_t cx = int32_t(dim) / 2, cy = int32_t(dim) / 2;
+
+        for (uint32_t sx = 0; sx < dim; ++sx) {
+            int32_t u = int32_t(sx), w = int32_t(py);
+            if (affine) {
+                const int32_t dx = u - cx, dy = w - cy;
+                u = (wrap_i32(uint32_t(T.pa) * uint32_t(dx) + uint32_t(T.pb) * uint32_t(dy)) >> 8) + cx;
+                w = (wrap_i32(uint32_t(T.pc) * uint32_t(dx) + uint32_t(T.pd) * uint32_t(dy)) >> 8) + cy;
+            }
+            if (objMosaic) {
+                u = wrap_i32((uint32_t(u) / mx) * mx);
+                w = wrap_i32((uint32_t(w) / my) * my);
+            }
+            if (u < 0 || w < 0 || u >= int32_t(dim) || w >= int32_t(dim)) continue;
+
+            const uint32_t tileIdx = tile + (uint32_t(w) >> 3) * tilesPerRow + (uint32_t(u) >> 3);
+            uint16_t entry = 0;
+            if (!is8) {
+                const uint32_t row = vram32(v, f.objCharBase + tileIdx * 32u + (uint32_t(w) & 7u) * 4u);
+                const uint32_t nib = (row >> ((uint32_t(u) & 7u) << 2)) & 0xFu;
+                if (nib) entry = uint16_t(LUT_OBJ + ((palBank * 16u + nib) & 0xFFu));
+            } else {
+                const uint32_t idx = vram8(v, f.objCharBase + tileIdx * 64u + (uint32_t(w) & 7u) * 8u + (uint32_t(u) & 7u));
+                if (idx) entry = uint16_t(LUT_OBJ + idx);
+            }
+            if (!entry) continue;
+
+            // every screen x whose 512-wrapped sprite column is sx
+            for (uint32_t x = (ox + sx) & 511u; x < f.fbW; x += 512u) {
+                uint8_t& fl = L.objFlags[x];
+                if (objMode == 2u) fl |= OBJ_WIN;
+                const bool take = !(fl & OBJ_VALID) || pri < L.objPri[x] || (pri == L.objPri[x] && i < L.objIdx[x]);
+                if (!take) continue;
+                L.obj[x] = entry;
+                L.objPri[x] = uint8_t(pri);
+                L.objIdx[x] = uint8_t(i);
+                fl = uint8_t((fl & OBJ_WIN) | OBJ_VALID | ((objMode == 1u) ? OBJ_SEMI : 0));
+            }
+        }
+    }
+}
+
+struct Cand { uint32_t entry, pri, bias, layerBit, semi, valid; };
+
+static inline void consider(const Cand& c, Cand& top, Cand& second) {
+    if (!top.valid || c.pri < top.pri || (c.pri == top.pri && c.bias > top.bias)) { second = top; top = c; }
+    else if (!second.valid || c.pri < second.pri || (c.pri == second.pri && c.bias > second.bias)) second = c;
+}
+
+// Windows, priority reduce and the choice of color op; the colors themselves
+// are resolved by the SIMD kernel.
+static void compose_line(const FrameIn& f, uint32_t y, LineBuf& L, ResolveFn resolve, uint32_t* out) {
+    const AgbHwState& s = *f.s;
+    const Scanline& sl = scan_at(f, y);
+    const WinState& w = s.win;
+    const bool lineOverride = (sl.flags & 1u) != 0;
+
+    uint32_t x1 = w.win0[0], x2 = w.win0[2];
+    if (lineOverride) { x1 = sl.win0x1; x2 = sl.win0x2; }
+    const bool yIn0 = y >= w.win0[1] && y < w.win0[3];
+    const bool yIn1 = y >= w.win1[1] && y < w.win1[3];
+
+    const uint32_t bldcnt   = lineOverride ? sl.bldcnt   : s.fx.bldcnt;
+    const uint32_t bldalpha = lineOverride ? sl.bldalpha : s.fx.bldalpha;
+    const uint32_t bldy     = lineOverride ? sl.bldy     : s.fx.bldy;
+    const uint32_t mode = (bldcnt >> 6) & 3u;
+
+    for (uint32_t x = 0; x < f.fbW; ++x) {
+        uint32_t mask = (yIn0 && x >= x1 && x < x2) ? w.winIn0
+                      : (yIn1 && x >= w.win1[0] && x < w.win1[2]) ? w.winIn1 : w.winOut;
+        const uint8_t fl = L.objFlags[x];
+        if (fl & OBJ_WIN) mask = w.winObj;
+        const bool allowFX = (mask & 0x20u) != 0;
+
+        Cand top{}, second{};
+        if ((fl & OBJ_VALID) && (mask & 0x10u))
+            consider({ L.obj[x], L.objPri[x], 1u, 4u, uint32_t((fl & OBJ_SEMI) != 0), 1u }, top, second);
+        for (uint32_t id = 0; id < AGB_BG_COUNT; ++id) {
+            const uint16_t e = L.bg[id][x];
+            if (e && (mask & (1u << id))) consider({ e, s.bg_params[id].pri, 0u, id, 0u, 1u }, top, second);
+        }
+
+        uint8_t op = OP_COPY;
+        if (top.valid && top.semi && second.valid) op = OP_ALPHA;
+        else if (top.valid && allowFX) {
+            const bool first = (bldcnt >> top.layerBit) & 1u;
+            if (mode == 1u && first && second.valid && ((bldcnt >> (8u + second.layerBit)) & 1u)) op = OP_ALPHA;
+            else if (mode == 2u && first) op = OP_BRIGHTEN;
+            else if (mode == 3u && first) op = OP_DARKEN;
+        }
+        L.top[x] = uint16_t(top.valid ? top.entry : 0u);   // entry 0: backdrop
+        L.second[x] = uint16_t(second.valid ? second.entry : 0u);
+        L.op[x] = op;
+    }
+
+    resolve(f.lut, L.top.data(), L.second.data(), L.op.data(), f.fbW,
+        std::min(bldalpha & 0x1Fu, 16u), std::min((bldalpha >> 8) & 0x1Fu, 16u), std::min(bldy & 0x1Fu, 16u),
+        out + size_t(y) * f.fbW);
+}
+
+static void render_lines(const FrameIn& f, uint32_t y0, uint32_t y1, LineBuf& L, ResolveFn resolve, uint32_t* out) {
+    L.resize(f.fbW);
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t id = 0; id < AGB_BG_COUNT; ++id) {
+            const BGParam& P = f.s->bg_params[id];
+            if (!P.enabled) std::fill(L.bg[id].begin(), L.bg[id].end(), uint16_t(0));
+            else if (id == 2 && (P.flags & AGB_BG_FLAG_AFFINE)) render_affine_bg(f, id, y, L.bg[id].data());   // BG2 only, like the shader
+            else render_text_bg(f, id, y, L.bg[id].data());
+        }
+        render_obj(f, y, L);
+        compose_line(f, y, L, resolve, out);
+    }
+}
+
+// ---- Context ------------------------------------------------------------------
+struct AgbCpuCtx {
+    AgbHwState state{};                         // as uploaded
+    std::array<uint32_t, LUT_ENTRIES> lut{};
+    bool lutStale = true;                       // palettes written since the last expand
+    std::array<uint32_t, 6> lastPc = DEFAULT_PC;
+    std::vector<uint32_t> fb;
+    std::vector<uint32_t> batchLut;
+    ResolveFn resolve = resolve_scalar;
+    Pool pool;
+    std::vector<LineBuf> scratch;               // one per pool thread
+};
+
+// Same clipping as agbvk's write_input: writes past the input are dropped.
+template <class T>
+static void write_field(T& field, size_t offset, const void* src, size_t countBytes) {
+    if (offset >= sizeof(field)) return;
+    countBytes = std::min(countBytes, sizeof(field) - offset);
+    std::memcpy(reinterpret_cast<uint8_t*>(&field) + offset, src, countBytes);
+}
+
+extern "C" {
+
+AgbCpuCtx* agbcpu_create(void) { return agbcpu_create_with(nullptr); }
+
+AgbCpuCtx* agbcpu_create_with(const AgbCpuConfig* cfg) {
+    AgbCpuConfig config{};
+    if (cfg) config = *cfg;
+    uint32_t threads = config.threads;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    auto* c = new AgbCpuCtx();
+    c->resolve = pick_resolve(config.noSimd != 0);
+    c->pool.start(threads);
+    c->scratch.resize(c->pool.size());
+    return c;
+}
+
+void agbcpu_destroy(AgbCpuCtx* c) {
+    if (!c) return;
+    c->pool.stop();
+    delete c;
+}
+
+// ---- Uploads ------------------------------------------------------------------
+void agbcpu_upload_vram(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.vram, 0, bytes, n); }
+void agbcpu_upload_pal_bg(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.pal_bg, 0, bytes, n); c->lutStale = true; }
+void agbcpu_upload_bg_params(AgbCpuCtx* c, const uint32_t* u32, size_t n) { write_field(c->state.bg_params, 0, u32, n * sizeof(uint32_t)); }
+void agbcpu_upload_pal_obj(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.pal_obj, 0, bytes, n); c->lutStale = true; }
+void agbcpu_upload_oam(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.oam, 0, bytes, n); }
+void agbcpu_upload_win(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.win, 0, bytes, n); }
+void agbcpu_upload_fx(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.fx, 0, bytes, n); }
+void agbcpu_upload_scanline(AgbCpuCtx* c, const void* bytes, size_t n) { write_field(c->state.scan, 0, bytes, n); }
+void agbcpu_upload_bg_aff(AgbCpuCtx* c, const int32_t* i32, size_t n) { write_field(c->state.bgAff, 0, i32, n * sizeof(int32_t)); }
+void agbcpu_upload_obj_aff(AgbCpuCtx* c, const int32_t* i32, size_t n) { write_field(c->state.objAff, 0, i32, n * sizeof(int32_t)); }
+
+void agbcpu_upload_vram_range(AgbCpuCtx* c, size_t off, const void* bytes, size_t n) { write_field(c->state.vram, off, bytes, n); }
+void agbcpu_upload_pal_bg_range(AgbCpuCtx* c, size_t off, const void* bytes, size_t n) { write_field(c->state.pal_bg, off, bytes, n); c->lutStale = true; }
+void agbcpu_upload_pal_obj_range(AgbCpuCtx* c, size_t off, const void* bytes, size_t n) { write_field(c->state.pal_obj, off, bytes, n); c->lutStale = true; }
+void agbcpu_upload_oam_range(AgbCpuCtx* c, size_t off, const void* bytes, size_t n) { write_field(c->state.oam, off, bytes, n); }
+void agbcpu_upload_scanline_range(AgbCpuCtx* c, size_t off, const void* bytes, size_t n) { write_field(c->state.scan, off, bytes, n); }
+
+AgbHwState* agbcpu_map_state(AgbCpuCtx* c) {
+    c->lutStale = true;   // the caller may rewrite the palettes
+    return &c->state;
+}
+
+// ---- Dispatch + readback --------------------------------------------------------
+void agbcpu_dispatch_frame(AgbCpuCtx* c, uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH, uint32_t objCharBase, uint32_t objMapMode) {
+    c->lastPc = { fbW, fbH, mapW, mapH, objCharBase, objMapMode };
+    c->fb.resize(size_t(fbW) * fbH);
+    if (c->fb.empty()) return;
+    if (c->lutStale) {
+        expand_palettes(c->state, c->lut.data());
+        c->lutStale = false;
+    }
+
+    const FrameIn f = frame_in(c->state, c->lut.data(), c->lastPc);
+    const uint32_t tasks = (fbH + LINES_PER_TASK - 1) / LINES_PER_TASK;
+    c->pool.run(tasks, [c, &f](uint32_t t, uint32_t worker) {
+        const uint32_t y0 = t * LINES_PER_TASK;
+        render_lines(f, y0, std::min(y0 + LINES_PER_TASK, f.fbH), c->scratch[worker], c->resolve, c->fb.data());
+    });
+}
+
+void agbcpu_readback_rgba(AgbCpuCtx* c, uint32_t* dstRGBA, size_t pixelCount) {
+    std::memcpy(dstRGBA, c->fb.data(), std::min(pixelCount, c->fb.size()) * sizeof(uint32_t));
+}
+
+void agbcpu_readback_rect(AgbCpuCtx* c, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride) {
+    const uint32_t fbW = c->lastPc[0], fbH = c->lastPc[1];
+    if (c->fb.empty() || x >= fbW || y >= fbH) return;
+    w = std::min(w, fbW - x);
+    h = std::min(h, fbH - y);
+    for (uint32_t row = 0; row < h; ++row)
+        std::memcpy(dst + row * dstStride, c->fb.data() + size_t(y + row) * fbW + x, w * sizeof(uint32_t));
+}
+
+int agbcpu_acquire_frame(AgbCpuCtx* c, const uint32_t** pixels, size_t* stride) {
+    if (c->fb.empty()) return 0;
+    *pixels = c->fb.data();
+    *stride = c->lastPc[0];
+    return 1;
+}
+
+void agbcpu_release_frame(AgbCpuCtx*) {}
+
+// ---- Batch rendering --------------------------------------------------------------
+void agbcpu_render_batch(AgbCpuCtx* c, const AgbHwState* states, size_t n, uint32_t* outRGBA) {
+    const std::array<uint32_t, 6>& pc = c->lastPc;
+    const size_t pixels = size_t(pc[0]) * pc[1];
+    if (n == 0 || pixels == 0) return;
+
+    // Palettes first, one state per task; then every state's line chunks.
+    c->batchLut.resize(n * LUT_ENTRIES);
+    c->pool.run(uint32_t(n), [c, states](uint32_t k, uint32_t) {
+        expand_palettes(states[k], c->batchLut.data() + size_t(k) * LUT_ENTRIES);
+    });
+
+    const uint32_t perState = (pc[1] + LINES_PER_TASK - 1) / LINES_PER_TASK;
+    c->pool.run(uint32_t(n * perState), [&](uint32_t t, uint32_t worker) {
+        const uint32_t k = t / perState, y0 = (t % perState) * LINES_PER_TASK;
+        const FrameIn f = frame_in(states[k], c->batchLut.data() + size_t(k) * LUT_ENTRIES, pc);
+        render_lines(f, y0, std::min(y0 + LINES_PER_TASK, f.fbH), c->scratch[worker], c->resolve,
+            outRGBA + k * pixels);
+    });
+}
+
+} // extern "C"
@@ -0,0 +1,78 @@
+#pragma once
+
+// CPU compositor: same inputs and bit-identical RGBA8 output as
+// compose_frame.comp, for hosts without a usable GPU. Scanlines are rendered
+// in parallel on a thread pool; palette lookup and color math use SSE4.1/AVX2
+// kernels picked at runtime. tests/agb_cpu_parity checks the paths against
+// each other and, where a GPU exists, against the shader.
+
+#if defined(__cplusplus)
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+typedef struct AgbCpuCtx AgbCpuCtx;          // Opaque renderer context
+typedef struct AgbHwState AgbHwState;        // Host-side GBA state (agb_hw_state.h)
+
+// Creation options; zero-initialize and set only what you need.
+typedef struct AgbCpuConfig {
+    uint32_t threads;          // worker threads including the caller (0 = hardware concurrency)
+    uint32_t noSimd;           // nonzero: scalar kernels only
+} AgbCpuConfig;
+
+// ---- Lifecycle ----
+AgbCpuCtx* agbcpu_create(void);                          // default config
+AgbCpuCtx* agbcpu_create_with(const AgbCpuConfig* cfg);  // cfg may be NULL
+void       agbcpu_destroy(AgbCpuCtx* ctx);
+
+// ---- Upload endpoints (same layouts and sizes as agbvk_upload_*) ----
+void agbcpu_upload_vram(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_pal_bg(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_bg_params(AgbCpuCtx*, const uint32_t* u32, size_t countU32);
+void agbcpu_upload_pal_obj(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_oam(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_win(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_fx(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_scanline(AgbCpuCtx*, const void* bytes, size_t countBytes);
+void agbcpu_upload_bg_aff(AgbCpuCtx*, const int32_t* i32, size_t countI32);
+void agbcpu_upload_obj_aff(AgbCpuCtx*, const int32_t* i32, size_t countI32);
+
+void agbcpu_upload_vram_range(AgbCpuCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbcpu_upload_pal_bg_range(AgbCpuCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbcpu_upload_pal_obj_range(AgbCpuCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbcpu_upload_oam_range(AgbCpuCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbcpu_upload_scanline_range(AgbCpuCtx*, size_t offset, const void* bytes, size_t countBytes);
+
+// The state the next dispatch renders, for writing in place (no upload copy).
+// Unlike agbvk_map_state it keeps everything uploaded so far; valid until
+// agbcpu_destroy.
+AgbHwState* agbcpu_map_state(AgbCpuCtx*);
+
+// ---- Dispatch + readback ----
+// Push-constants = {fbW, fbH, mapW, mapH, objCharBase, objMapMode(0=2D,1=1D)}.
+// Renders synchronously; the framebuffer stays readable until the next dispatch.
+void agbcpu_dispatch_frame(AgbCpuCtx*, uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH,
+    uint32_t objCharBase, uint32_t objMapMode);
+void agbcpu_readback_rgba(AgbCpuCtx*, uint32_t* dstRGBA, size_t pixelCount);
+// Like agbvk_readback_rect (there is a single session).
+void agbcpu_readback_rect(AgbCpuCtx*, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride);
+// Like agbvk_acquire_frame: the framebuffer itself, rows *stride pixels apart,
+// valid until the next dispatch. 0 before the first dispatch. Release is a no-op.
+int  agbcpu_acquire_frame(AgbCpuCtx*, const uint32_t** pixels, size_t* stride);
+void agbcpu_release_frame(AgbCpuCtx*);
+
+// ---- Batch rendering ----
+// Like agbvk_render_batch: compose `n` states back to back into outRGBA with
+// the latest dispatch's push constants (240x160 demo defaults before the
+// first one), without touching the uploaded state.
+void agbcpu_render_batch(AgbCpuCtx*, const AgbHwState* states, size_t n, uint32_t* outRGBA);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
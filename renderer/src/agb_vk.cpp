@@ -1,37 +1,174 @@
 ﻿#include "agb_vk.h"
+#include "agb_hw_state.h"
+#include "agb_state_layout.h"
 
 #include <vulkan/vulkan.h>
 #include <cstdint>
 #include <cstddef>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <stdexcept>
+#include <initializer_list>
 #include <fstream>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 // ---------- Compile-time contract (from your original main.cpp) ----------
-#ifndef SHADER_SPV_PATH
-#define SHADER_SPV_PATH "compose_frame.comp.spv"
-#endif
+// SPIR-V embedded at build time by renderer/cmake/embed_spirv.cmake.
+extern "C" const unsigned char agbvk_compose_frame_spv[];
+extern "C" const size_t agbvk_compose_frame_spv_size;
+extern "C" const unsigned char agbvk_obj_bin_spv[];
+extern "C" const size_t agbvk_obj_bin_spv_size;
+extern "C" const unsigned char agbvk_pal_lut_spv[];
+extern "C" const size_t agbvk_pal_lut_spv_size;
+extern "C" const unsigned char agbvk_reduce_frame_spv[];
+extern "C" const size_t agbvk_reduce_frame_spv_size;
+extern "C" const unsigned char agbvk_frame_info_spv[];
+extern "C" const size_t agbvk_frame_info_spv_size;
+extern "C" const unsigned char agbvk_upscale_frame_spv[];
+extern "C" const size_t agbvk_upscale_frame_spv_size;
+
+// Environment fallback for AgbVkConfig::pipelineCachePath.
+static constexpr const char* PIPELINE_CACHE_ENV = "AGBVK_PIPELINE_CACHE";
+
+// Descriptor bindings, exactly in shader order.
+// 0: out, 1: state (one AgbHwState per layer, see agb_state_layout.h),
+// 2: layer map (dispatch z -> session/batch layer), 3: OBJ line bins,
+// 4: palette LUT
+static constexpr uint32_t BINDING_COUNT = 5;
+
+// Per-layer prepasses that run before compose, only for layers whose inputs
+// changed. Their outputs are bound at 3 + PrepassId.
+enum PrepassId : uint32_t { PRE_OBJ_BINS, PRE_PAL_LUT, PREPASS_COUNT };
+static constexpr VkDeviceSize PREPASS_BYTES[PREPASS_COUNT] = {
+    256 * 4 * sizeof(uint32_t),     // obj_bin.comp: 256 sprite lines x 128-bit OAM mask
+    (512 + 256) * sizeof(uint32_t), // pal_lut.comp: BG + OBJ colors as RGBA8
+};
+static constexpr uint32_t PREPASS_GROUPS_X[PREPASS_COUNT] = { 1, 3 };   // workgroups per layer
+
+// Sizes (bytes) of the AgbHwState sections, each a contiguous run of words
+// in the packed state (agb_state_layout.h); checked against the struct below.
+static constexpr VkDeviceSize VRAM_BYTES = 96 * 1024;        // native bytes, packed 4 per uint
+static constexpr VkDeviceSize PAL_BG_BYTES = 1024;             // native bytes, packed 4 per uint
+static constexpr VkDeviceSize PAL_OBJ_BYTES = 512;              // native bytes, packed 4 per uint
+static constexpr VkDeviceSize OAM_BYTES = 1024;             // native bytes, packed 4 per uint
+static constexpr VkDeviceSize WIN_BYTES = 48;               // AGB_STATE_WIN_WORDS (12) words
+static constexpr VkDeviceSize FX_BYTES = 16;               // 4 words: bldcnt, bldalpha, bldy, mosaic
+static constexpr VkDeviceSize SCAN_BYTES = 160 * 80;         // 160 lines of AGB_STATE_SCAN_WORDS (20) words
+static constexpr VkDeviceSize BG_PARAMS_U32 = 4 * 8;            // 4 BGs of AGB_STATE_BG_PARAM_WORDS
+static constexpr VkDeviceSize BG_AFF_I32 = 4 * 6;            // 4 sets of AGB_STATE_BG_AFF_WORDS
+static constexpr VkDeviceSize OBJ_AFF_I32 = 32 * 4;           // 32 sets of AGB_STATE_OBJ_AFF_WORDS
+
+// Sections of the state buffer the host writes separately (AgbInput order).
+enum InputId : uint32_t {
+    IN_VRAM, IN_PAL_BG, IN_BG_PARAMS, IN_PAL_OBJ, IN_OAM,
+    IN_WIN, IN_FX, IN_SCAN, IN_BG_AFF, IN_OBJ_AFF, INPUT_COUNT
+};
+static constexpr VkDeviceSize INPUT_BYTES[INPUT_COUNT] = {
+    VRAM_BYTES, PAL_BG_BYTES, BG_PARAMS_U32 * sizeof(uint32_t), PAL_OBJ_BYTES, OAM_BYTES,
+    WIN_BYTES, FX_BYTES, SCAN_BYTES, BG_AFF_I32 * sizeof(int32_t), OBJ_AFF_I32 * sizeof(int32_t),
+};
+
+// Where each input lives inside an AgbHwState, and so inside each layer of the
+// state buffer and of the staging buffers.
+static constexpr size_t STATE_OFFSET[INPUT_COUNT] = {
+    offsetof(AgbHwState, vram), offsetof(AgbHwState, pal_bg), offsetof(AgbHwState, bg_params),
+    offsetof(AgbHwState, pal_obj), offsetof(AgbHwState, oam), offsetof(AgbHwState, win),
+    offsetof(AgbHwState, fx), offsetof(AgbHwState, scan), offsetof(AgbHwState, bgAff),
+    offsetof(AgbHwState, objAff),
+};
+static constexpr VkDeviceSize STATE_BYTES = sizeof(AgbHwState);   // state/staging stride per layer
+static_assert(STATE_BYTES % 16 == 0, "AgbHwState slots must stay 16-byte aligned in staging");
+static_assert(sizeof(AgbHwState::vram) == VRAM_BYTES && sizeof(AgbHwState::pal_bg) == PAL_BG_BYTES &&
+    sizeof(AgbHwState::bg_params) == BG_PARAMS_U32 * sizeof(uint32_t) &&
+    sizeof(AgbHwState::pal_obj) == PAL_OBJ_BYTES && sizeof(AgbHwState::oam) == OAM_BYTES &&
+    sizeof(AgbHwState::win) == WIN_BYTES && sizeof(AgbHwState::fx) == FX_BYTES &&
+    sizeof(AgbHwState::scan) == SCAN_BYTES && sizeof(AgbHwState::bgAff) == BG_AFF_I32 * sizeof(int32_t) &&
+    sizeof(AgbHwState::objAff) == OBJ_AFF_I32 * sizeof(int32_t),
+    "AgbHwState fields must match the shader input sizes");
+static_assert(offsetof(AgbHwState, vram) == AGB_STATE_VRAM * 4 && offsetof(AgbHwState, pal_bg) == AGB_STATE_PAL_BG * 4 &&
+    offsetof(AgbHwState, pal_obj) == AGB_STATE_PAL_OBJ * 4 && offsetof(AgbHwState, oam) == AGB_STATE_OAM * 4 &&
+    offsetof(AgbHwState, bg_params) == AGB_STATE_BG_PARAMS * 4 && offsetof(AgbHwState, win) == AGB_STATE_WIN * 4 &&
+    offsetof(AgbHwState, fx) == AGB_STATE_FX * 4 && offsetof(AgbHwState, scan) == AGB_STATE_SCAN * 4 &&
+    offsetof(AgbHwState, bgAff) == AGB_STATE_BG_AFF * 4 && offsetof(AgbHwState, objAff) == AGB_STATE_OBJ_AFF * 4 &&
+    sizeof(AgbHwState) == AGB_STATE_WORDS * 4 && AGB_STATE_VRAM_BYTES == AGB_VRAM_SIZE &&
+    AGB_STATE_SCANLINES == AGB_SCANLINES,
+    "AgbHwState offsets must match renderer/shaders/agb_state_layout.h");
+static_assert(sizeof(BGParam) == AGB_STATE_BG_PARAM_WORDS * 4 && sizeof(WinState) == AGB_STATE_WIN_WORDS * 4 &&
+    sizeof(Scanline) == AGB_STATE_SCAN_WORDS * 4 && sizeof(AffineParam) == AGB_STATE_BG_AFF_WORDS * 4 &&
+    sizeof(ObjAff) == AGB_STATE_OBJ_AFF_WORDS * 4,
+    "State element strides must match renderer/shaders/agb_state_layout.h");
+
+// Frames that may be recorded/executing at once (each owns a FrameSlot).
+static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 8;
+
+// Sessions per context (each one a layer of every input and of the output).
+static constexpr uint32_t MAX_SESSIONS = 1024;
 
-// Descriptor bindings: 0..10, exactly in shader order.
-// 0: out, 1: vram, 2: palBG, 3: bgParams, 4: palOBJ, 5: oam,
-// 6: win, 7: fx, 8: scan, 9: bgAff, 10: objAff  (matches your program).  :contentReference[oaicite:3]{index=3}
-
-// Buffer sizes (bytes) — identical to your program’s allocations.  :contentReference[oaicite:4]{index=4}
-static constexpr VkDeviceSize VRAM_BYTES = 96 * 1024;        // but stored as uint-per-byte
-static constexpr VkDeviceSize PAL_BG_BYTES = 1024;             // uint-per-byte
-static constexpr VkDeviceSize PAL_OBJ_BYTES = 512;              // uint-per-byte
-static constexpr VkDeviceSize OAM_BYTES = 1024;             // uint-per-byte
-static constexpr VkDeviceSize WIN_BYTES = 64;               // raw bytes
-static constexpr VkDeviceSize FX_BYTES = 16;               // raw bytes (3 dwords padded)  :contentReference[oaicite:5]{index=5}
-static constexpr VkDeviceSize SCAN_BYTES = 160 * 80;         // raw bytes (160 lines * ~80B) :contentReference[oaicite:6]{index=6}
-static constexpr VkDeviceSize BG_PARAMS_U32 = 4 * 8;            // 32 u32’s
-static constexpr VkDeviceSize BG_AFF_I32 = 4 * 6;            // 24 i32’s
-static constexpr VkDeviceSize OBJ_AFF_I32 = 32 * 4;           // 128 i32’s
-
-// The original sample fixed FB to 240x160 and allocated outBuf accordingly.  :contentReference[oaicite:7]{index=7}
+// Specialized pipelines kept per context; scenes beyond this use the uber-shader.
+static constexpr size_t MAX_VARIANTS = 64;
+
+// Pre-recorded compose command buffers kept per slot (LRU on push constants).
+static constexpr uint32_t COMPOSE_CACHE_SIZE = 4;
+
+// States composed per batch dispatch (one z layer each); longer batches are
+// split into chunks of this many.
+static constexpr uint32_t MAX_BATCH_LAYERS = 64;
+
+// Output mode of a frame: an AgbVkOutputFormat plus OUTPUT_HALF for the 2x
+// box downscale (both reduce_frame.comp), OUTPUT_INFO for frame_info.comp and
+// an AgbVkUpscale at OUTPUT_UPSCALE_SHIFT for upscale_frame.comp.
+// 0 = plain RGBA8, composed straight into outBuf.
+static constexpr uint32_t OUTPUT_FORMAT_MASK = 0xFF;
+static constexpr uint32_t OUTPUT_HALF = 0x100;
+static constexpr uint32_t OUTPUT_INFO = 0x200;
+static constexpr uint32_t OUTPUT_UPSCALE_SHIFT = 12;
+static constexpr uint32_t UPSCALE_WG = 16;  // upscale workgroup: 16x16 source pixels
+static constexpr uint32_t REDUCE_WG = 64;   // output words per workgroup
+static constexpr uint32_t INFO_WG = 16;     // frame info workgroup: 16x16 pixels
+static constexpr uint32_t INFO_WORDS = 8;   // frame info results per session (frame_info.comp)
+
+// Passes after compose that write a slot's output buffers. Each has its own
+// set layout (storage buffers at bindings 0..n-1, see write_pass_set) and is
+// compiled by the setter that first enables it.
+enum OutputPassId : uint32_t { PASS_REDUCE, PASS_INFO, PASS_UPSCALE, OUTPUT_PASS_COUNT };
+
+// True if the frame's output buffer holds reduce_frame.comp's packed output.
+static bool reduced(uint32_t output) { return (output & (OUTPUT_FORMAT_MASK | OUTPUT_HALF)) != 0; }
+
+// Upscale factor of an output mode (0 = no upscale pass).
+static uint32_t upscale_factor(uint32_t output) {
+    switch ((output >> OUTPUT_UPSCALE_SHIFT) & 0xF) {
+    case AGBVK_UPSCALE_NEAREST_2X: return 2;
+    case AGBVK_UPSCALE_NEAREST_3X: return 3;
+    case AGBVK_UPSCALE_NEAREST_4X: return 4;
+    case AGBVK_UPSCALE_SCALE2X:    return 2;
+    default:                       return 0;
+    }
+}
+
+// Bytes of one session's output for a frame of fbW x fbH (word-padded).
+static VkDeviceSize output_frame_bytes(uint32_t fbW, uint32_t fbH, uint32_t output) {
+    const bool half = (output & OUTPUT_HALF) != 0;
+    const VkDeviceSize pixels = VkDeviceSize(half ? fbW / 2 : fbW) * (half ? fbH / 2 : fbH);
+    const uint32_t fmt = output & OUTPUT_FORMAT_MASK;
+    const uint32_t perWord = fmt == AGBVK_OUTPUT_GRAY8 ? 4 : fmt == AGBVK_OUTPUT_RGBA8 ? 1 : 2;
+    return (pixels + perWord - 1) / perWord * sizeof(uint32_t);
+}
+
+// The original sample fixed FB to 240x160; framebuffers start at that size and
+// grow when a submit asks for more.
 static constexpr uint32_t DEFAULT_FB_W = 240;
 static constexpr uint32_t DEFAULT_FB_H = 160;
 
@@ -42,22 +179,99 @@ static void vkCheck(VkResult r, const char* what) {
         std::terminate(); // same spirit as your prototype (fail fast).  :contentReference[oaicite:8]{index=8}
     }
 }
-static std::vector<char> readFile(const char* path) {
+// Whole file, or empty if it is missing/unreadable (a cold cache is not an error).
+static std::vector<char> readFileIfExists(const std::string& path) {
     std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error(std::string("Cannot open file: ") + path);
+    if (!f) return {};
     f.seekg(0, std::ios::end);
     size_t n = size_t(f.tellg());
     f.seekg(0);
     std::vector<char> buf(n);
-    f.read(buf.data(), n);
+    if (!f.read(buf.data(), n)) return {};
     return buf;
 }
-static uint32_t findMemoryType(VkPhysicalDevice phys, uint32_t typeBits, VkMemoryPropertyFlags props) {
+static VkShaderModule createShaderModule(VkDevice dev, const unsigned char* code, size_t size) {
+    std::vector<uint32_t> words((size + 3) / 4);   // pCode must be 4-byte aligned
+    std::memcpy(words.data(), code, size);
+    VkShaderModuleCreateInfo smci{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+    smci.codeSize = size;
+    smci.pCode = words.data();
+    VkShaderModule m{};
+    vkCheck(vkCreateShaderModule(dev, &smci, nullptr, &m), "vkCreateShaderModule");
+    return m;
+}
+// True if `blob` is pipeline cache data written by this exact driver/device.
+static bool cacheMatchesDevice(const std::vector<char>& blob, const VkPhysicalDeviceProperties& pp) {
+    VkPipelineCacheHeaderVersionOne h{};
+    if (blob.size() < sizeof(h)) return false;
+    std::memcpy(&h, blob.data(), sizeof(h));
+    return h.headerSize >= sizeof(h) && h.headerSize <= blob.size()
+        && h.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && h.vendorID == pp.vendorID && h.deviceID == pp.deviceID
+        && std::memcmp(h.pipelineCacheUUID, pp.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+// Write through a temporary file renamed over `path`. On POSIX the rename
+// replaces the file atomically, so readers see the old or the new cache, never
+// a torn one, and concurrent writers just race for the last word. Windows'
+// rename() refuses to replace, so there the old file is removed first, which
+// briefly leaves no cache (a cold start, not a corrupt one).
+static void writeFileReplace(const std::string& path, const std::vector<char>& data) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+        if (!f) return;
+        f.write(data.data(), std::streamsize(data.size()));
+        if (!f) { f.close(); std::remove(tmp.c_str()); return; }
+    }
+#if defined(_WIN32)
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) std::remove(tmp.c_str());
+}
+// ---- Memory-type policy ----
+// Every buffer belongs to one role (AgbVkMemoryRole order). A role lists
+// property sets from most to least preferred; the last one is the
+// requirement. Readbacks want HOST_CACHED (CPU reads from uncached,
+// write-combined memory are many times slower), uploads want ReBAR
+// (DEVICE_LOCAL | HOST_VISIBLE), shader-only buffers want DEVICE_LOCAL.
+// Non-coherent picks are flushed/invalidated by Buffer.
+enum MemRole : uint32_t { MEM_SHADER, MEM_UPLOAD, MEM_READBACK, MEM_ROLE_COUNT };
+static constexpr uint32_t MEM_PREFS = 4;
+static constexpr VkMemoryPropertyFlags MEM_DL = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+static constexpr VkMemoryPropertyFlags MEM_HV = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+static constexpr VkMemoryPropertyFlags MEM_HC = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+static constexpr VkMemoryPropertyFlags MEM_CACHED = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+static constexpr VkMemoryPropertyFlags ROLE_PREFS[MEM_ROLE_COUNT][MEM_PREFS] = {
+    { MEM_DL, 0, 0, 0 },                                                    // shader-only
+    { MEM_DL | MEM_HV | MEM_HC, MEM_DL | MEM_HV, MEM_HV | MEM_HC, MEM_HV },  // upload
+    { MEM_HV | MEM_CACHED | MEM_HC, MEM_HV | MEM_CACHED, MEM_HV | MEM_HC, MEM_HV },   // readback
+};
+static bool host_role(MemRole role) { return role != MEM_SHADER; }
+
+// Allocate `size` bytes for `role` from the best memory type in `typeBits`.
+// A type whose heap is exhausted (the ReBAR heap is often only 256 MB) is
+// skipped in favour of the next preference.
+static VkDeviceMemory allocate_for_role(VkPhysicalDevice phys, VkDevice dev, VkDeviceSize size,
+    uint32_t typeBits, MemRole role, uint32_t* outType, VkMemoryPropertyFlags* outProps) {
     VkPhysicalDeviceMemoryProperties mp{};
     vkGetPhysicalDeviceMemoryProperties(phys, &mp);
-    for (uint32_t i = 0; i < mp.memoryTypeCount; ++i) {
-        if ((typeBits & (1u << i)) && (mp.memoryTypes[i].propertyFlags & props) == props)
-            return i;
+    uint32_t tried = 0;
+    for (VkMemoryPropertyFlags want : ROLE_PREFS[role]) {
+        for (uint32_t i = 0; i < mp.memoryTypeCount; ++i) {
+            const uint32_t bit = 1u << i;
+            if (!(typeBits & bit) || (tried & bit) || (mp.memoryTypes[i].propertyFlags & want) != want) continue;
+            tried |= bit;
+            VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+            ai.allocationSize = size;
+            ai.memoryTypeIndex = i;
+            VkDeviceMemory mem{};
+            const VkResult r = vkAllocateMemory(dev, &ai, nullptr, &mem);
+            if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY || r == VK_ERROR_OUT_OF_HOST_MEMORY) continue;
+            vkCheck(r, "vkAllocateMemory");
+            *outType = i;
+            *outProps = mp.memoryTypes[i].propertyFlags;
+            return mem;
+        }
     }
     throw std::runtime_error("No suitable memory type.");
 }
@@ -66,30 +280,330 @@ struct Buffer {
     VkBuffer buffer{};
     VkDeviceMemory memory{};
     VkDeviceSize size{};
+    VkDeviceSize memOffset{};       // where the buffer starts in `memory`
+    VkDeviceSize allocSize{};       // size of `memory`
+    bool ownsMemory{};              // false when bound into a BufferArena
+    bool hostImported{};            // memory is caller-owned host memory (import_host)
+    uint32_t memType{};
+    VkMemoryPropertyFlags props{};
+
+    // Host-visible buffers stay mapped from create() to destroy(). For memory
+    // that is not HOST_COHERENT, host writes are tracked as one dirty range
+    // and flushed before the GPU reads them; reads are preceded by invalidate.
+    void* mapped{};
+    VkDeviceSize atom{ 1 };                 // nonCoherentAtomSize
+    VkDeviceSize dirtyLo{ 0 }, dirtyHi{ 0 }; // [lo, hi) written since last flush
 
     void create(VkPhysicalDevice phys, VkDevice dev, VkDeviceSize sz,
-        VkBufferUsageFlags usage, VkMemoryPropertyFlags props) {
+        VkBufferUsageFlags usage, MemRole role) {
         device = dev; size = sz;
         VkBufferCreateInfo bi{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
         bi.size = sz; bi.usage = usage; bi.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         vkCheck(vkCreateBuffer(dev, &bi, nullptr, &buffer), "vkCreateBuffer");
         VkMemoryRequirements req{};
         vkGetBufferMemoryRequirements(dev, buffer, &req);
-        VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
-        ai.allocationSize = req.size;
-        ai.memoryTypeIndex = findMemoryType(phys, req.memoryTypeBits, props);
-        vkCheck(vkAllocateMemory(dev, &ai, nullptr, &memory), "vkAllocateMemory");
+        memory = allocate_for_role(phys, dev, req.size, req.memoryTypeBits, role, &memType, &props);
         vkCheck(vkBindBufferMemory(dev, buffer, memory, 0), "vkBindBufferMemory");
+        allocSize = req.size;
+        memOffset = 0;
+        ownsMemory = true;
+
+        if (host_role(role) && (props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+            VkPhysicalDeviceProperties pp{};
+            vkGetPhysicalDeviceProperties(phys, &pp);
+            atom = pp.limits.nonCoherentAtomSize ? pp.limits.nonCoherentAtomSize : 1;
+            vkCheck(vkMapMemory(dev, memory, 0, VK_WHOLE_SIZE, 0, &mapped), "vkMapMemory");
+        }
+    }
+    // Bind `sz` bytes of caller memory at `ptr` (VK_EXT_external_memory_host)
+    // instead of allocating; `mapped` is `ptr` itself. False, with nothing
+    // created, if the driver refuses the pointer.
+    bool import_host(VkPhysicalDevice phys, VkDevice dev, void* ptr, VkDeviceSize sz,
+        VkBufferUsageFlags usage, MemRole role, PFN_vkGetMemoryHostPointerPropertiesEXT getProps) {
+        const auto handle = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+        VkMemoryHostPointerPropertiesEXT hp{ VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT };
+        if (getProps(dev, handle, ptr, &hp) != VK_SUCCESS || !hp.memoryTypeBits) return false;
+
+        VkExternalMemoryBufferCreateInfo ext{ VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO };
+        ext.handleTypes = handle;
+        VkBufferCreateInfo bi{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+        bi.pNext = &ext;
+        bi.size = sz; bi.usage = usage; bi.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkBuffer buf{};
+        vkCheck(vkCreateBuffer(dev, &bi, nullptr, &buf), "vkCreateBuffer");
+        VkMemoryRequirements req{};
+        vkGetBufferMemoryRequirements(dev, buf, &req);
+
+        // The pages are already there: take the role's most preferred type
+        // the pointer allows, with no fallback on failure.
+        VkPhysicalDeviceMemoryProperties mp{};
+        vkGetPhysicalDeviceMemoryProperties(phys, &mp);
+        const uint32_t typeBits = req.memoryTypeBits & hp.memoryTypeBits;
+        uint32_t type = mp.memoryTypeCount;
+        for (VkMemoryPropertyFlags want : ROLE_PREFS[role]) {
+            for (uint32_t i = 0; i < mp.memoryTypeCount && type == mp.memoryTypeCount; ++i)
+                if ((typeBits & (1u << i)) && (mp.memoryTypes[i].propertyFlags & want) == want) type = i;
+            if (type != mp.memoryTypeCount) break;
+        }
+        VkImportMemoryHostPointerInfoEXT imp{ VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT };
+        imp.handleType = handle;
+        imp.pHostPointer = ptr;
+        VkMemoryAllocateInfo ai{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+        ai.pNext = &imp;
+        ai.allocationSize = sz;
+        ai.memoryTypeIndex = type;
+        VkDeviceMemory mem{};
+        if (req.size > sz || type == mp.memoryTypeCount || vkAllocateMemory(dev, &ai, nullptr, &mem) != VK_SUCCESS) {
+            vkDestroyBuffer(dev, buf, nullptr);
+            return false;
+        }
+        vkCheck(vkBindBufferMemory(dev, buf, mem, 0), "vkBindBufferMemory");
+
+        device = dev; buffer = buf; memory = mem; size = sz;
+        allocSize = sz; memOffset = 0; ownsMemory = true; hostImported = true;
+        memType = type; props = mp.memoryTypes[type].propertyFlags;
+        VkPhysicalDeviceProperties pp{};
+        vkGetPhysicalDeviceProperties(phys, &pp);
+        atom = pp.limits.nonCoherentAtomSize ? pp.limits.nonCoherentAtomSize : 1;
+        mapped = ptr;
+        return true;
+    }
+    bool coherent() const { return (props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0; }
+
+    // Atom-aligned [off, off+len) of this buffer, clamped to the allocation.
+    VkMappedMemoryRange range(VkDeviceSize off, VkDeviceSize len) const {
+        VkMappedMemoryRange r{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE };
+        r.memory = memory;
+        off += memOffset;
+        r.offset = off / atom * atom;
+        VkDeviceSize end = (off + len + atom - 1) / atom * atom;
+        r.size = (end >= allocSize) ? VK_WHOLE_SIZE : end - r.offset;
+        return r;
+    }
+    void markDirty(VkDeviceSize off, VkDeviceSize len) {
+        if (coherent() || len == 0) return;
+        if (dirtyHi == dirtyLo) { dirtyLo = off; dirtyHi = off + len; return; }
+        if (off < dirtyLo) dirtyLo = off;
+        if (off + len > dirtyHi) dirtyHi = off + len;
+    }
+    void flushDirty() {
+        if (dirtyHi == dirtyLo) return;
+        VkMappedMemoryRange r = range(dirtyLo, dirtyHi - dirtyLo);
+        vkCheck(vkFlushMappedMemoryRanges(device, 1, &r), "vkFlushMappedMemoryRanges");
+        dirtyLo = dirtyHi = 0;
+    }
+    void invalidate(VkDeviceSize off, VkDeviceSize len) {
+        if (coherent()) return;
+        VkMappedMemoryRange r = range(off, len);
+        vkCheck(vkInvalidateMappedMemoryRanges(device, 1, &r), "vkInvalidateMappedMemoryRanges");
     }
-    void* map() { void* p = nullptr; vkCheck(vkMapMemory(device, memory, 0, size, 0, &p), "vkMapMemory"); return p; }
-    void  unmap() { vkUnmapMemory(device, memory); }
     void  destroy() {
+        if (mapped && ownsMemory && !hostImported) vkUnmapMemory(device, memory);
         if (buffer) vkDestroyBuffer(device, buffer, nullptr);
-        if (memory) vkFreeMemory(device, memory, nullptr);
+        if (memory && ownsMemory) vkFreeMemory(device, memory, nullptr);
         buffer = VK_NULL_HANDLE; memory = VK_NULL_HANDLE; device = VK_NULL_HANDLE; size = 0;
+        mapped = nullptr; dirtyLo = dirtyHi = 0; ownsMemory = false; hostImported = false;
+    }
+};
+
+// One VkDeviceMemory shared by several buffers, each bound at an offset that
+// satisfies its alignment. In host-visible memory every buffer also starts on
+// a nonCoherentAtomSize boundary, so one buffer's flush/invalidate ranges
+// never cover another's bytes. The buffers keep their own handles and are
+// destroyed as usual; destroy() here (afterwards) frees and unmaps the memory.
+struct BufferArena {
+    struct Part { Buffer* buf; VkDeviceSize size; VkBufferUsageFlags usage; };
+
+    VkDevice device{};
+    VkDeviceMemory memory{};
+    uint32_t memType{};
+    void* mapped{};
+
+    void create(VkPhysicalDevice phys, VkDevice dev, std::initializer_list<Part> parts, MemRole role) {
+        device = dev;
+        VkPhysicalDeviceProperties pp{};
+        vkGetPhysicalDeviceProperties(phys, &pp);
+        const VkDeviceSize atom = pp.limits.nonCoherentAtomSize ? pp.limits.nonCoherentAtomSize : 1;
+
+        std::vector<VkDeviceSize> offsets;
+        VkDeviceSize total = 0;
+        uint32_t typeBits = ~0u;
+        for (const Part& part : parts) {
+            Buffer& b = *part.buf;
+            b.device = dev; b.size = part.size;
+            VkBufferCreateInfo bi{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+            bi.size = part.size; bi.usage = part.usage; bi.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            vkCheck(vkCreateBuffer(dev, &bi, nullptr, &b.buffer), "vkCreateBuffer");
+            VkMemoryRequirements req{};
+            vkGetBufferMemoryRequirements(dev, b.buffer, &req);
+            const VkDeviceSize align = std::max<VkDeviceSize>(req.alignment, host_role(role) ? atom : 1);
+            total = (total + align - 1) / align * align;
+            offsets.push_back(total);
+            total += req.size;
+            typeBits &= req.memoryTypeBits;
+        }
+        if (!typeBits) throw std::runtime_error("No memory type suits every buffer of the allocation.");
+
+        VkMemoryPropertyFlags props{};
+        memory = allocate_for_role(phys, dev, total, typeBits, role, &memType, &props);
+        if (host_role(role) && (props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+            vkCheck(vkMapMemory(dev, memory, 0, VK_WHOLE_SIZE, 0, &mapped), "vkMapMemory");
+
+        size_t i = 0;
+        for (const Part& part : parts) {
+            Buffer& b = *part.buf;
+            const VkDeviceSize off = offsets[i++];
+            vkCheck(vkBindBufferMemory(dev, b.buffer, memory, off), "vkBindBufferMemory");
+            b.memory = memory; b.memOffset = off; b.allocSize = total; b.ownsMemory = false;
+            b.memType = memType; b.props = props; b.atom = atom;
+            b.mapped = mapped ? static_cast<uint8_t*>(mapped) + off : nullptr;
+            b.dirtyLo = b.dirtyHi = 0;
+        }
+    }
+    void destroy() {
+        if (mapped) vkUnmapMemory(device, memory);
+        if (memory) vkFreeMemory(device, memory, nullptr);
+        memory = VK_NULL_HANDLE; mapped = nullptr; device = VK_NULL_HANDLE;
+    }
+};
+
+// Write tracking for one section of the state. Spans are in layered input
+// space (session s's copy starts at s*INPUT_BYTES[id]); the device-local state
+// buffer and every frame's staging buffer hold one AgbHwState per session, so
+// that copy lives at s*STATE_BYTES + STATE_OFFSET[id] in both. Host writes
+// land in the current frame's staging and record the written byte spans; that
+// frame's submit copies exactly those spans across before the compose pass
+// runs. Device-local contents accumulate, so bytes nobody wrote keep their
+// previously uploaded values.
+struct Input {
+    struct Span { VkDeviceSize lo, hi; };
+
+    std::vector<Span> dirty;       // written since the last submit (may overlap)
+    std::vector<uint8_t> shadow;   // host copy of the uploaded bytes (small inputs only)
+
+    void markDirty(VkDeviceSize off, VkDeviceSize len) {
+        if (len == 0) return;
+        dirty.push_back({ off, off + len });
+        if (dirty.size() > 64) coalesce();
+    }
+    // Sort and merge overlapping/adjacent spans (copy regions must not overlap).
+    void coalesce() {
+        if (dirty.size() < 2) return;
+        std::sort(dirty.begin(), dirty.end(), [](const Span& a, const Span& b) { return a.lo < b.lo; });
+        size_t n = 0;
+        for (size_t i = 1; i < dirty.size(); ++i) {
+            if (dirty[i].lo <= dirty[n].hi) dirty[n].hi = std::max(dirty[n].hi, dirty[i].hi);
+            else dirty[++n] = dirty[i];
+        }
+        dirty.resize(n + 1);
     }
 };
 
+// Scene features that select a specialized compose pipeline (see the
+// constant_id block in compose_frame.comp). Masks are unions over every layer
+// in the dispatch; anything a layer might need keeps its path enabled.
+static constexpr uint32_t BLEND_PER_LINE = 4;   // SC_BLEND_MODE: read BLDCNT per pixel
+
+struct SceneKey {
+    uint32_t bgMask{}, affMask{}, objAny{}, winActive{}, blendMode{};
+};
+
+static SceneKey scene_key(const BGParam* bg, const uint8_t* oam, const WinState& win,
+    const FxRegs& fx, const Scanline* scan) {
+    SceneKey k;
+    for (uint32_t i = 0; i < AGB_BG_COUNT; ++i) {
+        if (!bg[i].enabled) continue;
+        k.bgMask |= 1u << i;
+        if (i == 2 && (bg[i].flags & AGB_BG_FLAG_AFFINE)) k.affMask |= 1u << i;   // shader: BG2 only
+    }
+    for (uint32_t i = 0; i < 128 && !k.objAny; ++i) {
+        const uint32_t a0 = oam[i * 8] | (uint32_t(oam[i * 8 + 1]) << 8);
+        if (((a0 >> 8) & 3u) != 2u) k.objAny = 1;
+    }
+    auto full = [](uint32_t m) { return (m & 0x3Fu) == 0x3Fu; };
+    k.winActive = !(full(win.winIn0) && full(win.winIn1) && full(win.winOut) && full(win.winObj));
+    k.blendMode = (fx.bldcnt >> 6) & 3u;
+    for (uint32_t y = 0; y < AGB_SCANLINES; ++y) {
+        if ((scan[y].flags & 1u) && ((scan[y].bldcnt >> 6) & 3u) != k.blendMode) {
+            k.blendMode = BLEND_PER_LINE;
+            break;
+        }
+    }
+    return k;
+}
+static void merge_scene_key(SceneKey& a, const SceneKey& b) {
+    a.bgMask |= b.bgMask;
+    a.affMask |= b.affMask;
+    a.objAny |= b.objAny;
+    a.winActive |= b.winActive;
+    if (a.blendMode != b.blendMode) a.blendMode = BLEND_PER_LINE;
+}
+
+// Specialization constant values, in constant_id order.
+using VariantKey = std::array<uint32_t, 9>;
+static constexpr VariantKey UBER_KEY = { 0xFu, 0x4u, 1, 1, BLEND_PER_LINE, 0, 0, 0, 0 };   // shader defaults
+
+// Compose workgroup shape (constant_id 9/10): scanline strips, so the text BG
+// row cache in compose_frame.comp is shared by WG_W pixels of each line.
+static constexpr uint32_t COMPOSE_WG_W = 32, COMPOSE_WG_H = 4;
+static VariantKey variant_key(const SceneKey& k, const std::array<uint32_t, 6>& pc) {
+    return { k.bgMask, k.affMask, k.objAny, k.winActive, k.blendMode, pc[0], pc[1], pc[2], pc[3] };
+}
+
+// The compose pass only varies with its push constants, the number of active
+// sessions and the output mode, so its command buffer is recorded once per
+// distinct combination and resubmitted as-is afterwards (which sessions are
+// active is read from the slot's layer map, not baked in).
+struct ComposeCmd {
+    std::array<uint32_t, 6> pc{};  // fbW, fbH, mapW, mapH, objCharBase, objMapMode
+    uint32_t layers{};             // dispatch depth = active sessions
+    uint32_t output{};             // output mode: passes appended after compose (0 = none)
+    VkPipeline pipe{};             // uber-shader or a specialized variant
+    VkCommandBuffer cmd{};
+    uint64_t lastUse{};
+};
+
+// Per-frame resources. Frames rotate through the slots; a slot is written by
+// the host again only after its fence has signalled.
+struct FrameSlot {
+    Buffer          staging;       // host-written state for this frame, one AgbHwState per session
+    Buffer          outBuf;        // composed RGBA8 framebuffers, one per session
+    Buffer          layerMap;      // [0, K): active session ids; [(1+p)K, (2+p)K): prepass p's sessions
+    BufferArena     uploadMem;     // backs staging and layerMap
+    VkDescriptorSet dset{};
+    VkDescriptorSet composedDset{};  // dset with binding 0 = the context's `composed` (reduced output)
+    VkDescriptorSet passSet[OUTPUT_PASS_COUNT]{};  // per output pass, allocated with its pipeline
+    VkCommandBuffer uploadCmd{};   // re-recorded per frame, only when inputs changed
+    ComposeCmd      compose[COMPOSE_CACHE_SIZE];
+    VkQueryPool     timestamps{};  // [0] frame start, [1] compose end (null when unsupported)
+    VkCommandBuffer tsBeginCmd{};  // resets `timestamps` and writes [0]; recorded once
+    VkFence         fence{};
+    uint64_t        ticket{};      // frame last submitted from this slot (0 = none)
+    uint32_t        output{};      // output mode of `ticket`
+    std::array<uint32_t, 2> fbDims{}; // fbW, fbH of `ticket`
+    Buffer          infoBuf;       // frame info results, INFO_WORDS per session
+    std::vector<uint8_t> infoState; // per session in `ticket`: 0 no info, 1 compared, 2 no previous frame
+    Buffer          upBuf;         // upscaled framebuffers, one per session (made on first use)
+    bool            pending{};     // submitted and fence not yet observed
+};
+
+// A layered state buffer plus one framebuffer per layer, used by
+// agbvk_render_batch. Grown on demand; only touched between fence waits.
+struct Batch {
+    uint32_t        layers{};      // capacity in layers (0 = not created yet)
+    Buffer          state;         // `layers` AgbHwStates back to back
+    Buffer          pre[PREPASS_COUNT];
+    BufferArena     deviceMem;     // backs state and pre
+    Buffer          staging;       // same layout as state
+    Buffer          layerMap;      // identity: z -> layer z
+    BufferArena     uploadMem;     // backs staging and layerMap
+    Buffer          out;
+    VkDeviceSize    outLayerBytes{};
+    VkDescriptorSet dset{};
+    VkCommandBuffer cmd{};
+    VkFence         fence{};
+};
+
 // ---------- Opaque context (all Vulkan state lives here) ----------
 struct AgbVkCtx {
     // Core
@@ -98,31 +612,270 @@ struct AgbVkCtx {
     uint32_t         qFamily{};
     VkDevice         dev{};
     VkQueue          queue{};
+    uint32_t         tsValidBits{};   // of qFamily; 0 = no timestamp queries
+    float            tsPeriod{};      // ns per timestamp tick
+
+    // VK_EXT_external_memory_host, loaded only when output memory is imported
+    PFN_vkGetMemoryHostPointerPropertiesEXT hostPtrProps{};
+    VkDeviceSize     hostPtrAlign{};  // minImportedHostPointerAlignment
+    bool             outputImported{}; // every slot's outBuf is caller memory
 
-    // Buffers (11 SSBOs)
-    Buffer outBuf, vramBuf, palBuf, bgBuf, palObjBuf, oamBuf,
-        winBuf, fxBuf, scanBuf, affBuf, objAffBuf;
+    // Device-local state (shared by all frames), one AgbHwState per session,
+    // and the write tracking of its sections
+    Buffer       state;
+    Input        in[INPUT_COUNT];
+    VkDeviceSize stagingBytes{};   // = state size
+
+    // Sessions: uploads/maps target `session`; submits compose every active one.
+    uint32_t             sessions{ 1 };
+    uint32_t             session{};
+    std::vector<uint8_t> sessionActive;
+    std::vector<uint32_t> activeScratch;
+    std::vector<SceneKey> sessionKey;      // per session, from the shadowed inputs
+    std::vector<uint8_t>  sessionKeyStale;
+
+    // Prepasses; a session is rerun by the first frame that composes it after
+    // the prepass's inputs changed.
+    struct Prepass {
+        VkShaderModule       shader{};
+        VkPipeline           pipe{};
+        Buffer               out;           // device-local, one layer per session
+        std::vector<uint8_t> stale;
+    };
+    Prepass               pre[PREPASS_COUNT];
+    BufferArena           deviceMem;        // backs state and every pre[p].out
+    VkPipelineLayout      prePl{};          // shared: push constant = listBase
+
+    // Reduced output: frames are composed into `composed` (device-local, made
+    // on first use and shared by the slots) and reduce_frame.comp writes
+    // outBuf through the slot's PASS_REDUCE set.
+    uint32_t              output{};         // for the next submit
+    Buffer                composed;
+    VkDeviceSize          fbBytes{};        // RGBA8 framebuffers of every session
+
+    // Frame info: frame_info.comp compares `composed` with prevFrame (device-
+    // local, the last frame composed per session) and updates it, through the
+    // slot's PASS_INFO set. A session's first frame has nothing to compare against.
+    bool                  frameInfo{};      // for the next submit
+    Buffer                prevFrame;
+    std::vector<uint8_t>  infoPrevValid;    // per session
+    std::array<uint32_t, 2> infoDims{};     // fbW, fbH prevFrame was written at
+
+    // Upscale: upscale_frame.comp enlarges `composed` into each slot's upBuf,
+    // through the slot's PASS_UPSCALE set.
+    uint32_t              upscale{};        // AgbVkUpscale for the next submit
+
+    // Output passes (OutputPassId); null until first enabled.
+    struct OutputPass {
+        VkDescriptorSetLayout dsl{};
+        VkPipelineLayout      pl{};
+        VkShaderModule        shader{};
+        VkPipeline            pipe{};
+    };
+    OutputPass            passes[OUTPUT_PASS_COUNT];
+
+    std::vector<VkBufferCopy> copyScratch;
 
     // Descriptors/pipeline
     VkDescriptorSetLayout dsl{};
     VkPipelineLayout      pl{};
     VkShaderModule        shader{};
-    VkPipeline            pipe{};
+    VkPipelineCache       pipeCache{};
+    std::string           pipeCachePath;    // empty => cache not persisted
+    VkPipeline            pipe{};           // uber-shader (all features on)
     VkDescriptorPool      pool{};
-    VkDescriptorSet       dset{};
 
-    // Commands/sync
-    VkCommandPool   cmdPool{};
-    VkCommandBuffer cmd{};
-    VkFence         fence{};
+    // Specialized variants, compiled on a background thread. Frames use the
+    // uber-shader until their variant is ready.
+    bool                         variantsEnabled{};
+    std::thread                  compiler;
+    std::mutex                   variantMtx;
+    std::condition_variable      variantCv;
+    std::deque<VariantKey>       variantQueue;
+    std::set<VariantKey>         variantRequested;
+    std::map<VariantKey, VkPipeline> variants;
+    bool                         compilerQuit{};
+
+    // Commands/sync: one slot per frame in flight
+    VkCommandPool          cmdPool{};
+    std::vector<FrameSlot> slots;
+    uint32_t               cur{};          // slot the host is writing into
+    uint64_t               nextTicket{ 1 };
+    uint64_t               acquiredTicket{};   // agbvk_acquire_frame, until released (0 = none)
+    bool                   reuseWarned{};
+
+    // Memory type the policy picked for each MemRole (-1 = none allocated
+    // yet), and the type of imported output memory, which the caller's
+    // pointer decides (-1 = nothing imported).
+    int32_t roleType[MEM_ROLE_COUNT]{ -1, -1, -1 };
+    int32_t importedType{ -1 };
+
+    // Push constants of the latest submit; batches render with these.
+    std::array<uint32_t, 6> lastPc{ DEFAULT_FB_W, DEFAULT_FB_H, 32, 32, 32 * 1024, 0 };
+
+    Batch batch;
 };
 
+// Point all bindings of `set` at `out`, the state buffer, layer map and
+// prepass outputs.
+static void write_dset(VkDevice dev, VkDescriptorSet set, const Buffer& out,
+    const Buffer& state, const Buffer& layerMap, const Buffer* const pre[PREPASS_COUNT]) {
+    VkDescriptorBufferInfo info[BINDING_COUNT] = {
+        { out.buffer, 0, out.size }, { state.buffer, 0, state.size }, { layerMap.buffer, 0, layerMap.size },
+    };
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p)
+        info[3 + p] = { pre[p]->buffer, 0, pre[p]->size };
+    VkWriteDescriptorSet writes[BINDING_COUNT]{};
+    for (uint32_t i = 0; i < BINDING_COUNT; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &info[i];
+    }
+    vkUpdateDescriptorSets(dev, BINDING_COUNT, writes, 0, nullptr);
+}
+
+// Point bindings 0..n-1 of `set` at `bufs`.
+static void write_buffers(VkDevice dev, VkDescriptorSet set, std::initializer_list<const Buffer*> bufs) {
+    VkDescriptorBufferInfo info[BINDING_COUNT];
+    VkWriteDescriptorSet writes[BINDING_COUNT]{};
+    uint32_t n = 0;
+    for (const Buffer* b : bufs) {
+        info[n] = { b->buffer, 0, b->size };
+        writes[n].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[n].dstSet = set;
+        writes[n].dstBinding = n;
+        writes[n].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[n].descriptorCount = 1;
+        writes[n].pBufferInfo = &info[n];
+        ++n;
+    }
+    vkUpdateDescriptorSets(dev, n, writes, 0, nullptr);
+}
+
+// Inputs the host mirrors to pick shader variants (everything but VRAM/palettes).
+static bool shadowed(InputId id) {
+    return id == IN_BG_PARAMS || id == IN_OAM || id == IN_WIN || id == IN_FX || id == IN_SCAN;
+}
+
+// Returns the VkResult instead of checking it: a failed background compile
+// only loses an optional specialization.
+static VkResult create_variant(AgbVkCtx* c, const VariantKey& key, VkPipeline* p) {
+    constexpr uint32_t n = std::tuple_size<VariantKey>::value + 2;   // + workgroup shape
+    std::array<uint32_t, n> data{};
+    std::copy(key.begin(), key.end(), data.begin());
+    data[n - 2] = COMPOSE_WG_W;
+    data[n - 1] = COMPOSE_WG_H;
+    VkSpecializationMapEntry entries[n];
+    for (uint32_t i = 0; i < n; ++i)
+        entries[i] = { i, uint32_t(i * sizeof(uint32_t)), sizeof(uint32_t) };
+    VkSpecializationInfo si{};
+    si.mapEntryCount = n; si.pMapEntries = entries;
+    si.dataSize = sizeof(data); si.pData = data.data();
+
+    VkPipelineShaderStageCreateInfo ssci{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+    ssci.stage = VK_SHADER_STAGE_COMPUTE_BIT; ssci.module = c->shader; ssci.pName = "main";
+    ssci.pSpecializationInfo = &si;
+    VkComputePipelineCreateInfo cpci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    cpci.stage = ssci; cpci.layout = c->pl;
+    return vkCreateComputePipelines(c->dev, c->pipeCache, 1, &cpci, nullptr, p);
+}
+
+// Background thread: compiles requested variants one at a time (the pipeline
+// cache is internally synchronized, so it is shared with the main thread).
+// A variant that fails to compile stays requested without a pipeline, so its
+// frames keep using the uber-shader and it is not retried.
+static void variant_compiler(AgbVkCtx* c) {
+    std::unique_lock<std::mutex> lk(c->variantMtx);
+    for (;;) {
+        c->variantCv.wait(lk, [c] { return c->compilerQuit || !c->variantQueue.empty(); });
+        if (c->compilerQuit) return;
+        const VariantKey key = c->variantQueue.front();
+        c->variantQueue.pop_front();
+        lk.unlock();
+        VkPipeline p{};
+        const VkResult r = create_variant(c, key, &p);
+        if (r != VK_SUCCESS)
+            std::cerr << "agbvk: shader variant compile failed (VkResult " << int(r) << "); using the general shader\n";
+        lk.lock();
+        if (r == VK_SUCCESS) c->variants[key] = p;
+    }
+}
+
+// Pipeline for a dispatch over layers with features `k`: the specialized
+// variant if it has been compiled, else the uber-shader (queueing the variant).
+static VkPipeline pick_pipeline(AgbVkCtx* c, const SceneKey& k, const std::array<uint32_t, 6>& pc) {
+    if (!c->variantsEnabled) return c->pipe;
+    const VariantKey key = variant_key(k, pc);
+    std::lock_guard<std::mutex> lk(c->variantMtx);
+    auto it = c->variants.find(key);
+    if (it != c->variants.end()) return it->second;
+    if (c->variantRequested.size() < MAX_VARIANTS && c->variantRequested.insert(key).second) {
+        c->variantQueue.push_back(key);
+        c->variantCv.notify_one();
+    }
+    return c->pipe;
+}
+
+// Slot for ticket t (tickets are issued in slot rotation order starting at 1).
+static FrameSlot& slot_of(AgbVkCtx* c, uint64_t ticket) {
+    return c->slots[size_t((ticket - 1) % c->slots.size())];
+}
+static void wait_slot(AgbVkCtx* c, FrameSlot& s) {
+    if (!s.pending) return;
+    vkCheck(vkWaitForFences(c->dev, 1, &s.fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+    s.pending = false;
+}
+// Slot the host may write into now; blocks while its previous frame executes.
+static FrameSlot& acquire_slot(AgbVkCtx* c) {
+    FrameSlot& s = c->slots[c->cur];
+    wait_slot(c, s);
+    return s;
+}
+
+// ---- Staging layout ----
+// Staging offset of byte `off` of the layered input `id`.
+static VkDeviceSize staged_offset(InputId id, VkDeviceSize off) {
+    const VkDeviceSize s = off / INPUT_BYTES[id];
+    return s * STATE_BYTES + STATE_OFFSET[id] + (off - s * INPUT_BYTES[id]);
+}
+// Split a span of input `id` at session boundaries: fn(stagingOff, inputOff, len).
+template <class Fn>
+static void for_each_staged(InputId id, const Input::Span& sp, Fn&& fn) {
+    for (VkDeviceSize lo = sp.lo; lo < sp.hi; ) {
+        const VkDeviceSize end = std::min(sp.hi, (lo / INPUT_BYTES[id] + 1) * INPUT_BYTES[id]);
+        fn(staged_offset(id, lo), lo, end - lo);
+        lo = end;
+    }
+}
+static uint8_t* staging_ptr(FrameSlot& fs, InputId id, VkDeviceSize off) {
+    return static_cast<uint8_t*>(fs.staging.mapped) + staged_offset(id, off);
+}
+
 // ---------- Public API implementation ----------
 extern "C" {
 
 AgbVkCtx* agbvk_create(void) {
+    return agbvk_create_with(nullptr);
+}
+
+AgbVkCtx* agbvk_create_with(const AgbVkConfig* cfg) {
     auto* c = new AgbVkCtx{};
 
+    uint32_t frames = (cfg && cfg->framesInFlight) ? cfg->framesInFlight : DEFAULT_FRAMES_IN_FLIGHT;
+    if (frames > MAX_FRAMES_IN_FLIGHT) frames = MAX_FRAMES_IN_FLIGHT;
+    c->slots.resize(frames);
+
+    uint32_t sessions = (cfg && cfg->sessions) ? cfg->sessions : 1;
+    if (sessions > MAX_SESSIONS) sessions = MAX_SESSIONS;
+    c->sessions = sessions;
+    c->sessionActive.assign(sessions, 1);
+    c->sessionKey.assign(sessions, SceneKey{});
+    c->sessionKeyStale.assign(sessions, 1);
+    for (auto& pp : c->pre) pp.stale.assign(sessions, 1);
+
     // 1) Instance  (matches your program)
     VkApplicationInfo app{ VK_STRUCTURE_TYPE_APPLICATION_INFO };
     app.pApplicationName = "agbvk";
@@ -147,56 +900,115 @@ AgbVkCtx* agbvk_create(void) {
         vkGetPhysicalDeviceQueueFamilyProperties(pd, &n, qfp.data());
         for (uint32_t i = 0; i < n; ++i) {
             if (qfp[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
-                c->phys = pd; c->qFamily = i; break;
+                c->phys = pd; c->qFamily = i; c->tsValidBits = qfp[i].timestampValidBits; break;
             }
         }
         if (c->phys) break;
     }
     if (!c->phys) throw std::runtime_error("No compute-capable queue.");       // :contentReference[oaicite:11]{index=11}
 
-    // 3) Device + queue
+    // 3) Device + queue. VK_EXT_external_memory_host only when the caller
+    //    wants its output memory imported and the device has it.
+    const bool importOutput = cfg && cfg->outputMemory;
+    bool hostMemExt = false;
+    if (importOutput) {
+        uint32_t n = 0;
+        vkEnumerateDeviceExtensionProperties(c->phys, nullptr, &n, nullptr);
+        std::vector<VkExtensionProperties> exts(n);
+        vkEnumerateDeviceExtensionProperties(c->phys, nullptr, &n, exts.data());
+        for (const auto& e : exts)
+            if (std::strcmp(e.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) hostMemExt = true;
+    }
+    const char* devExts[] = { VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME };
     float prio = 1.0f;
     VkDeviceQueueCreateInfo qci{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
     qci.queueFamilyIndex = c->qFamily; qci.queueCount = 1; qci.pQueuePriorities = &prio;
     VkDeviceCreateInfo dci{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
     dci.queueCreateInfoCount = 1; dci.pQueueCreateInfos = &qci;
+    dci.enabledExtensionCount = hostMemExt ? 1 : 0; dci.ppEnabledExtensionNames = devExts;
     vkCheck(vkCreateDevice(c->phys, &dci, nullptr, &c->dev), "vkCreateDevice");
     vkGetDeviceQueue(c->dev, c->qFamily, 0, &c->queue);
+    {
+        VkPhysicalDeviceProperties pp{};
+        vkGetPhysicalDeviceProperties(c->phys, &pp);
+        c->tsPeriod = pp.limits.timestampPeriod;
+    }
+    if (hostMemExt) {
+        VkPhysicalDeviceExternalMemoryHostPropertiesEXT hp{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT };
+        VkPhysicalDeviceProperties2 pp2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2 };
+        pp2.pNext = &hp;
+        vkGetPhysicalDeviceProperties2(c->phys, &pp2);
+        c->hostPtrAlign = hp.minImportedHostPointerAlignment ? hp.minImportedHostPointerAlignment : 1;
+        c->hostPtrProps = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+            vkGetDeviceProcAddr(c->dev, "vkGetMemoryHostPointerPropertiesEXT"));
+    }
 
-    // 4) Buffers (allocations identical to your program)  :contentReference[oaicite:12]{index=12}
-    const VkMemoryPropertyFlags HOST =
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    // 4) Buffers
+    //    The state buffer (one AgbHwState per session) and the prepass outputs
+    //    share one shader-only allocation. Each frame slot has one upload
+    //    allocation holding its persistently mapped staging buffer and layer
+    //    map, and a readback buffer for its output framebuffers (see MemRole),
+    //    imported from cfg->outputMemory when requested and possible.
     const VkBufferUsageFlags SSBO = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
-    // out framebuffer — initially sized for 240x160; see readback note below.
-    c->outBuf.create(c->phys, c->dev, DEFAULT_FB_W * DEFAULT_FB_H * sizeof(uint32_t), SSBO, HOST);
-
-    // uint-per-byte storages: vram, palBG, palOBJ, oam
-    c->vramBuf.create(c->phys, c->dev, VRAM_BYTES * sizeof(uint32_t), SSBO, HOST);
-    c->palBuf.create(c->phys, c->dev, PAL_BG_BYTES * sizeof(uint32_t), SSBO, HOST);
-    c->palObjBuf.create(c->phys, c->dev, PAL_OBJ_BYTES * sizeof(uint32_t), SSBO, HOST);
-    c->oamBuf.create(c->phys, c->dev, OAM_BYTES * sizeof(uint32_t), SSBO, HOST);
-
-    // raw byte storages: win, fx, scan; typed: bgParams (u32), bgAff (i32), objAff (i32)
-    c->winBuf.create(c->phys, c->dev, WIN_BYTES, SSBO, HOST);
-    c->fxBuf.create(c->phys, c->dev, FX_BYTES, SSBO, HOST);
-    c->scanBuf.create(c->phys, c->dev, SCAN_BYTES, SSBO, HOST);
-    c->bgBuf.create(c->phys, c->dev, BG_PARAMS_U32 * sizeof(uint32_t), SSBO, HOST);
-    c->affBuf.create(c->phys, c->dev, BG_AFF_I32 * sizeof(int32_t), SSBO, HOST);
-    c->objAffBuf.create(c->phys, c->dev, OBJ_AFF_I32 * sizeof(int32_t), SSBO, HOST);
-
-    // 5/6) Descriptor set layout (11 bindings), pipeline layout (push-consts)  :contentReference[oaicite:13]{index=13}
-    VkDescriptorSetLayoutBinding binds[11]{};
+    for (uint32_t i = 0; i < INPUT_COUNT; ++i) {
+        Input& in = c->in[i];
+        const VkDeviceSize bytes = INPUT_BYTES[i] * sessions;
+        in.markDirty(0, bytes);            // first submit uploads everything (zeroed)
+        if (shadowed(InputId(i))) in.shadow.assign(size_t(bytes), 0);
+    }
+    c->stagingBytes = STATE_BYTES * sessions;
+
+    c->deviceMem.create(c->phys, c->dev, {
+        { &c->state, c->stagingBytes, SSBO | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+        { &c->pre[PRE_OBJ_BINS].out, PREPASS_BYTES[PRE_OBJ_BINS] * sessions, SSBO },
+        { &c->pre[PRE_PAL_LUT].out, PREPASS_BYTES[PRE_PAL_LUT] * sessions, SSBO },
+    }, MEM_SHADER);
+    c->roleType[MEM_SHADER] = int32_t(c->deviceMem.memType);
+
+    // out framebuffers — initially sized for 240x160, grown by submits of larger frames.
+    const VkDeviceSize outBytes = VkDeviceSize(DEFAULT_FB_W) * DEFAULT_FB_H * sizeof(uint32_t) * sessions;
+    c->fbBytes = outBytes;
+    uint32_t imported = 0;
+    for (size_t i = 0; i < c->slots.size(); ++i) {
+        FrameSlot& fs = c->slots[i];
+        void* ext = importOutput ? cfg->outputMemory[i] : nullptr;
+        const VkDeviceSize extBytes = importOutput ? cfg->outputMemoryBytes : 0;
+        if (ext && c->hostPtrProps && extBytes >= outBytes
+            && reinterpret_cast<uintptr_t>(ext) % c->hostPtrAlign == 0 && extBytes % c->hostPtrAlign == 0
+            && fs.outBuf.import_host(c->phys, c->dev, ext, extBytes, SSBO, MEM_READBACK, c->hostPtrProps)) {
+            ++imported;
+            c->importedType = int32_t(fs.outBuf.memType);
+        } else {
+            fs.outBuf.create(c->phys, c->dev, outBytes, SSBO, MEM_READBACK);
+            c->roleType[MEM_READBACK] = int32_t(fs.outBuf.memType);
+        }
+        fs.uploadMem.create(c->phys, c->dev, {
+            { &fs.layerMap, (1 + PREPASS_COUNT) * sessions * sizeof(uint32_t), SSBO },
+            { &fs.staging, c->stagingBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+        }, MEM_UPLOAD);
+        c->roleType[MEM_UPLOAD] = int32_t(fs.uploadMem.memType);
+        std::memset(fs.staging.mapped, 0, c->stagingBytes);
+        fs.staging.markDirty(0, c->stagingBytes);
+    }
+    c->outputImported = importOutput && imported == c->slots.size();
+    if (importOutput && !c->outputImported)
+        std::cerr << "agbvk: output memory not imported for " << (c->slots.size() - imported) << " of "
+                  << c->slots.size() << " frame slots (" << (c->hostPtrProps ? "unaligned, too small or refused"
+                  : "no " VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) << "); using internal memory\n";
+
+    // 5/6) Descriptor set layout (BINDING_COUNT bindings), pipeline layout (push-consts)
+    VkDescriptorSetLayoutBinding binds[BINDING_COUNT]{};
     auto setB = [&](uint32_t idx) {
         binds[idx].binding = idx;
         binds[idx].descriptorCount = 1;
         binds[idx].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         binds[idx].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
         };
-    for (uint32_t i = 0; i < 11; ++i) setB(i);
+    for (uint32_t i = 0; i < BINDING_COUNT; ++i) setB(i);
 
     VkDescriptorSetLayoutCreateInfo dsli{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
-    dsli.bindingCount = 11; dsli.pBindings = binds;
+    dsli.bindingCount = BINDING_COUNT; dsli.pBindings = binds;
     vkCheck(vkCreateDescriptorSetLayout(c->dev, &dsli, nullptr, &c->dsl), "vkCreateDescriptorSetLayout");
 
     VkPushConstantRange pcr{};
@@ -208,174 +1020,1081 @@ AgbVkCtx* agbvk_create(void) {
     plci.pushConstantRangeCount = 1; plci.pPushConstantRanges = &pcr;
     vkCheck(vkCreatePipelineLayout(c->dev, &plci, nullptr, &c->pl), "vkCreatePipelineLayout");
 
-    // 7/8/9) Shader module and compute pipeline   :contentReference[oaicite:14]{index=14}
-    auto spirv = readFile(SHADER_SPV_PATH);
-    VkShaderModuleCreateInfo smci{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
-    smci.codeSize = spirv.size();
-    smci.pCode = reinterpret_cast<const uint32_t*>(spirv.data());
-    vkCheck(vkCreateShaderModule(c->dev, &smci, nullptr, &c->shader), "vkCreateShaderModule");
+    // 7/8/9) Shader module, pipeline cache and compute pipeline
+    c->shader = createShaderModule(c->dev, agbvk_compose_frame_spv, agbvk_compose_frame_spv_size);
+
+    // Seed the cache from disk when the blob came from this driver/device;
+    // anything else (missing, truncated, other GPU, driver update) starts cold.
+    const char* cachePath = (cfg && cfg->pipelineCachePath) ? cfg->pipelineCachePath : std::getenv(PIPELINE_CACHE_ENV);
+    std::vector<char> cacheBlob;
+    if (cachePath && *cachePath) {
+        c->pipeCachePath = cachePath;
+        VkPhysicalDeviceProperties pp{};
+        vkGetPhysicalDeviceProperties(c->phys, &pp);
+        cacheBlob = readFileIfExists(c->pipeCachePath);
+        if (!cacheMatchesDevice(cacheBlob, pp)) cacheBlob.clear();
+    }
+    VkPipelineCacheCreateInfo pcci{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO };
+    pcci.initialDataSize = cacheBlob.size();
+    pcci.pInitialData = cacheBlob.empty() ? nullptr : cacheBlob.data();
+    vkCheck(vkCreatePipelineCache(c->dev, &pcci, nullptr, &c->pipeCache), "vkCreatePipelineCache");
+
+    // Only the workgroup shape is specialized.
+    vkCheck(create_variant(c, UBER_KEY, &c->pipe), "vkCreateComputePipelines");
 
     VkPipelineShaderStageCreateInfo ssci{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
-    ssci.stage = VK_SHADER_STAGE_COMPUTE_BIT; ssci.module = c->shader; ssci.pName = "main";
-    VkComputePipelineCreateInfo cpci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
-    cpci.stage = ssci; cpci.layout = c->pl;
-    vkCheck(vkCreateComputePipelines(c->dev, VK_NULL_HANDLE, 1, &cpci, nullptr, &c->pipe),
-        "vkCreateComputePipelines");
+    ssci.stage = VK_SHADER_STAGE_COMPUTE_BIT; ssci.pName = "main";
+
+    // Prepasses: same descriptor set layout, their own push constant.
+    VkPushConstantRange prePcr{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) };   // listBase
+    VkPipelineLayoutCreateInfo pplci{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    pplci.setLayoutCount = 1; pplci.pSetLayouts = &c->dsl;
+    pplci.pushConstantRangeCount = 1; pplci.pPushConstantRanges = &prePcr;
+    vkCheck(vkCreatePipelineLayout(c->dev, &pplci, nullptr, &c->prePl), "vkCreatePipelineLayout");
+    c->pre[PRE_OBJ_BINS].shader = createShaderModule(c->dev, agbvk_obj_bin_spv, agbvk_obj_bin_spv_size);
+    c->pre[PRE_PAL_LUT].shader = createShaderModule(c->dev, agbvk_pal_lut_spv, agbvk_pal_lut_spv_size);
+    for (auto& pp : c->pre) {
+        VkComputePipelineCreateInfo pcpci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+        pcpci.stage = ssci; pcpci.stage.module = pp.shader; pcpci.layout = c->prePl;
+        vkCheck(vkCreateComputePipelines(c->dev, c->pipeCache, 1, &pcpci, nullptr, &pp.pipe),
+            "vkCreateComputePipelines");
+    }
 
-    // 10) Descriptor pool + set + writes  :contentReference[oaicite:15]{index=15}
-    VkDescriptorPoolSize poolSizes[1] = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 11 } };
+    c->variantsEnabled = !(cfg && cfg->noShaderVariants);
+    if (c->variantsEnabled) c->compiler = std::thread(variant_compiler, c);
+
+    // 10) Descriptor pool + one set per slot + writes
+    const uint32_t nSlots = uint32_t(c->slots.size());
+    //     (+composedDset and the output pass sets per slot and 1 set for
+    //     agbvk_render_batch, allocated on first use)
+    const uint32_t maxSets = (2 + OUTPUT_PASS_COUNT) * nSlots + 1;
+    VkDescriptorPoolSize poolSizes[1] = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT * maxSets } };
     VkDescriptorPoolCreateInfo dpci{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
-    dpci.maxSets = 1; dpci.poolSizeCount = 1; dpci.pPoolSizes = poolSizes;
+    dpci.maxSets = maxSets; dpci.poolSizeCount = 1; dpci.pPoolSizes = poolSizes;
     vkCheck(vkCreateDescriptorPool(c->dev, &dpci, nullptr, &c->pool), "vkCreateDescriptorPool");
 
-    VkDescriptorSetAllocateInfo dsai{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-    dsai.descriptorPool = c->pool; dsai.descriptorSetCount = 1; dsai.pSetLayouts = &c->dsl;
-    vkCheck(vkAllocateDescriptorSets(c->dev, &dsai, &c->dset), "vkAllocateDescriptorSets");
-
-    VkDescriptorBufferInfo info[11] = {
-        { c->outBuf.buffer,    0, c->outBuf.size },
-        { c->vramBuf.buffer,   0, c->vramBuf.size },
-        { c->palBuf.buffer,    0, c->palBuf.size },
-        { c->bgBuf.buffer,     0, c->bgBuf.size },
-        { c->palObjBuf.buffer, 0, c->palObjBuf.size },
-        { c->oamBuf.buffer,    0, c->oamBuf.size },
-        { c->winBuf.buffer,    0, c->winBuf.size },
-        { c->fxBuf.buffer,     0, c->fxBuf.size },
-        { c->scanBuf.buffer,   0, c->scanBuf.size },
-        { c->affBuf.buffer,    0, c->affBuf.size },
-        { c->objAffBuf.buffer, 0, c->objAffBuf.size },
-    };
-    VkWriteDescriptorSet writes[11]{};
-    for (uint32_t i = 0; i < 11; ++i) {
-        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        writes[i].dstSet = c->dset;
-        writes[i].dstBinding = i;
-        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-        writes[i].descriptorCount = 1;
-        writes[i].pBufferInfo = &info[i];
+    for (FrameSlot& fs : c->slots) {
+        VkDescriptorSetAllocateInfo dsai{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        dsai.descriptorPool = c->pool; dsai.descriptorSetCount = 1; dsai.pSetLayouts = &c->dsl;
+        vkCheck(vkAllocateDescriptorSets(c->dev, &dsai, &fs.dset), "vkAllocateDescriptorSets");
+
+        const Buffer* pre[PREPASS_COUNT];
+        for (uint32_t p = 0; p < PREPASS_COUNT; ++p) pre[p] = &c->pre[p].out;
+        write_dset(c->dev, fs.dset, fs.outBuf, c->state, fs.layerMap, pre);
     }
-    vkUpdateDescriptorSets(c->dev, 11, writes, 0, nullptr);
 
-    // 11) Command pool/buffer + fence   :contentReference[oaicite:16]{index=16}
+    // 11) Command pool + per-slot command buffer/fence
     VkCommandPoolCreateInfo cpci2{ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    cpci2.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;   // slots re-record individually
     cpci2.queueFamilyIndex = c->qFamily;
     vkCheck(vkCreateCommandPool(c->dev, &cpci2, nullptr, &c->cmdPool), "vkCreateCommandPool");
 
-    VkCommandBufferAllocateInfo cbai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
-    cbai.commandPool = c->cmdPool; cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; cbai.commandBufferCount = 1;
-    vkCheck(vkAllocateCommandBuffers(c->dev, &cbai, &c->cmd), "vkAllocateCommandBuffers");
+    for (FrameSlot& fs : c->slots) {
+        VkCommandBufferAllocateInfo cbai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        cbai.commandPool = c->cmdPool; cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; cbai.commandBufferCount = 1;
+        vkCheck(vkAllocateCommandBuffers(c->dev, &cbai, &fs.uploadCmd), "vkAllocateCommandBuffers");
+        for (ComposeCmd& cc : fs.compose)
+            vkCheck(vkAllocateCommandBuffers(c->dev, &cbai, &cc.cmd), "vkAllocateCommandBuffers");
+
+        VkFenceCreateInfo fci{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        vkCheck(vkCreateFence(c->dev, &fci, nullptr, &fs.fence), "vkCreateFence");
 
-    VkFenceCreateInfo fci{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    vkCheck(vkCreateFence(c->dev, &fci, nullptr, &c->fence), "vkCreateFence");
+        // GPU timing: every submit starts with tsBeginCmd, every compose pass
+        // ends with the second timestamp.
+        if (c->tsValidBits && c->tsPeriod > 0.0f) {
+            VkQueryPoolCreateInfo qpci{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+            qpci.queryType = VK_QUERY_TYPE_TIMESTAMP; qpci.queryCount = 2;
+            vkCheck(vkCreateQueryPool(c->dev, &qpci, nullptr, &fs.timestamps), "vkCreateQueryPool");
+            vkCheck(vkAllocateCommandBuffers(c->dev, &cbai, &fs.tsBeginCmd), "vkAllocateCommandBuffers");
+            VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+            vkCheck(vkBeginCommandBuffer(fs.tsBeginCmd, &bi), "vkBeginCommandBuffer");
+            vkCmdResetQueryPool(fs.tsBeginCmd, fs.timestamps, 0, 2);
+            vkCmdWriteTimestamp(fs.tsBeginCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, fs.timestamps, 0);
+            vkCheck(vkEndCommandBuffer(fs.tsBeginCmd), "vkEndCommandBuffer");
+        }
+    }
 
     return c;
 }
 
 // ---- Upload helpers ----------------------------------------------------
-static void write_bytes_as_u32(Buffer& buf, const void* srcBytes, size_t countBytes) {
-    // SSBO is laid out as "uint-per-byte" (your program wrote each byte into a u32 slot).  :contentReference[oaicite:17]{index=17}
-    auto* dst = static_cast<uint32_t*>(buf.map());
-    const auto* src = static_cast<const uint8_t*>(srcBytes);
-    for (size_t i = 0; i < countBytes; ++i) dst[i] = src[i];
-    buf.unmap();
-}
-static void write_bytes(Buffer& buf, const void* srcBytes, size_t countBytes) {
-    void* dst = buf.map();
-    std::memcpy(dst, srcBytes, countBytes);
-    buf.unmap();
-}
-static void write_u32(Buffer& buf, const uint32_t* srcU32, size_t countU32) {
-    void* dst = buf.map();
-    std::memcpy(dst, srcU32, countU32 * sizeof(uint32_t));
-    buf.unmap();
-}
-static void write_i32(Buffer& buf, const int32_t* srcI32, size_t countI32) {
-    void* dst = buf.map();
-    std::memcpy(dst, srcI32, countI32 * sizeof(int32_t));
-    buf.unmap();
-}
-
-void agbvk_upload_vram(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes_as_u32(c->vramBuf, bytes, n); }
-void agbvk_upload_pal_bg(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes_as_u32(c->palBuf, bytes, n); }
-void agbvk_upload_bg_params(AgbVkCtx* c, const uint32_t* u32, size_t n) { write_u32(c->bgBuf, u32, n); }
-void agbvk_upload_pal_obj(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes_as_u32(c->palObjBuf, bytes, n); }
-void agbvk_upload_oam(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes_as_u32(c->oamBuf, bytes, n); }
-void agbvk_upload_win(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes(c->winBuf, bytes, n); }
-void agbvk_upload_fx(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes(c->fxBuf, bytes, n); }
-void agbvk_upload_scanline(AgbVkCtx* c, const void* bytes, size_t n) { write_bytes(c->scanBuf, bytes, n); }
-void agbvk_upload_bg_aff(AgbVkCtx* c, const int32_t* i32, size_t n) { write_i32(c->affBuf, i32, n); }
-void agbvk_upload_obj_aff(AgbVkCtx* c, const int32_t* i32, size_t n) { write_i32(c->objAffBuf, i32, n); }
+// VRAM/palettes/OAM SSBOs hold the native little-endian byte layout (the shader
+// unpacks 4 bytes per uint), so every upload is a plain copy into staging.
+// Byte offset of the selected session's layer within an input.
+static VkDeviceSize session_base(const AgbVkCtx* c, InputId id) {
+    return INPUT_BYTES[id] * c->session;
+}
+static void write_input(AgbVkCtx* c, InputId id, size_t offset, const void* src, size_t countBytes) {
+    Input& in = c->in[id];
+    if (offset >= INPUT_BYTES[id]) return;
+    if (countBytes > INPUT_BYTES[id] - offset) countBytes = size_t(INPUT_BYTES[id] - offset);
+    offset += size_t(session_base(c, id));
+    FrameSlot& fs = acquire_slot(c);
+    std::memcpy(staging_ptr(fs, id, offset), src, countBytes);
+    in.markDirty(offset, countBytes);
+    fs.staging.markDirty(staged_offset(id, offset), countBytes);
+}
+
+void agbvk_upload_vram(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_VRAM, 0, bytes, n); }
+void agbvk_upload_pal_bg(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_PAL_BG, 0, bytes, n); }
+void agbvk_upload_bg_params(AgbVkCtx* c, const uint32_t* u32, size_t n) { write_input(c, IN_BG_PARAMS, 0, u32, n * sizeof(uint32_t)); }
+void agbvk_upload_pal_obj(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_PAL_OBJ, 0, bytes, n); }
+void agbvk_upload_oam(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_OAM, 0, bytes, n); }
+void agbvk_upload_win(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_WIN, 0, bytes, n); }
+void agbvk_upload_fx(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_FX, 0, bytes, n); }
+void agbvk_upload_scanline(AgbVkCtx* c, const void* bytes, size_t n) { write_input(c, IN_SCAN, 0, bytes, n); }
+void agbvk_upload_bg_aff(AgbVkCtx* c, const int32_t* i32, size_t n) { write_input(c, IN_BG_AFF, 0, i32, n * sizeof(int32_t)); }
+void agbvk_upload_obj_aff(AgbVkCtx* c, const int32_t* i32, size_t n) { write_input(c, IN_OBJ_AFF, 0, i32, n * sizeof(int32_t)); }
+
+void agbvk_upload_vram_range(AgbVkCtx* c, size_t off, const void* bytes, size_t n) { write_input(c, IN_VRAM, off, bytes, n); }
+void agbvk_upload_pal_bg_range(AgbVkCtx* c, size_t off, const void* bytes, size_t n) { write_input(c, IN_PAL_BG, off, bytes, n); }
+void agbvk_upload_pal_obj_range(AgbVkCtx* c, size_t off, const void* bytes, size_t n) { write_input(c, IN_PAL_OBJ, off, bytes, n); }
+void agbvk_upload_oam_range(AgbVkCtx* c, size_t off, const void* bytes, size_t n) { write_input(c, IN_OAM, off, bytes, n); }
+void agbvk_upload_scanline_range(AgbVkCtx* c, size_t off, const void* bytes, size_t n) { write_input(c, IN_SCAN, off, bytes, n); }
+
+// ---- Direct-write endpoints --------------------------------------------
+// The returned slice belongs to the frame being built and holds whatever that
+// slot staged last time, so the selected session's whole input is treated as
+// written.
+static void* map_for_write(AgbVkCtx* c, InputId id) {
+    Input& in = c->in[id];
+    FrameSlot& fs = acquire_slot(c);
+    const VkDeviceSize base = session_base(c, id);
+    in.markDirty(base, INPUT_BYTES[id]);
+    fs.staging.markDirty(staged_offset(id, base), INPUT_BYTES[id]);
+    return staging_ptr(fs, id, base);
+}
+
+void* agbvk_map_vram(AgbVkCtx* c) { return map_for_write(c, IN_VRAM); }
+void* agbvk_map_pal_bg(AgbVkCtx* c) { return map_for_write(c, IN_PAL_BG); }
+uint32_t* agbvk_map_bg_params(AgbVkCtx* c) { return static_cast<uint32_t*>(map_for_write(c, IN_BG_PARAMS)); }
+void* agbvk_map_pal_obj(AgbVkCtx* c) { return map_for_write(c, IN_PAL_OBJ); }
+void* agbvk_map_oam(AgbVkCtx* c) { return map_for_write(c, IN_OAM); }
+void* agbvk_map_win(AgbVkCtx* c) { return map_for_write(c, IN_WIN); }
+void* agbvk_map_fx(AgbVkCtx* c) { return map_for_write(c, IN_FX); }
+void* agbvk_map_scanline(AgbVkCtx* c) { return map_for_write(c, IN_SCAN); }
+int32_t* agbvk_map_bg_aff(AgbVkCtx* c) { return static_cast<int32_t*>(map_for_write(c, IN_BG_AFF)); }
+int32_t* agbvk_map_obj_aff(AgbVkCtx* c) { return static_cast<int32_t*>(map_for_write(c, IN_OBJ_AFF)); }
+
+AgbHwState* agbvk_map_state(AgbVkCtx* c) {
+    FrameSlot& fs = acquire_slot(c);
+    for (uint32_t i = 0; i < INPUT_COUNT; ++i)
+        c->in[i].markDirty(session_base(c, InputId(i)), INPUT_BYTES[i]);
+    fs.staging.markDirty(STATE_BYTES * c->session, STATE_BYTES);
+    return reinterpret_cast<AgbHwState*>(static_cast<uint8_t*>(fs.staging.mapped) + STATE_BYTES * c->session);
+}
+
+// Record prepass `p` over `n` layers listed from layerOf[listBase], ordered
+// after earlier compose passes (which read its output) and before the one
+// that follows.
+static void record_prepass(AgbVkCtx* c, PrepassId p, VkCommandBuffer cmd, VkDescriptorSet set,
+    uint32_t listBase, uint32_t n) {
+    VkMemoryBarrier prior{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };    // WAR vs compose, WAW vs last prepass
+    prior.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    prior.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &prior, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pre[p].pipe);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->prePl, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(cmd, c->prePl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(listBase), &listBase);
+    vkCmdDispatch(cmd, PREPASS_GROUPS_X[p], 1, n);
+
+    VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &mb, 0, nullptr, 0, nullptr);
+}
+
+// Staging -> state buffer copies for every dirty span (one copy command; both
+// buffers share the AgbHwState-per-session layout), bracketed by the barriers
+// that order them after earlier frames' compose reads and before this frame's
+// compose pass.
+static void record_copies(AgbVkCtx* c, FrameSlot& fs) {
+    // Earlier frames may still be reading (WAR) or copying into (WAW) the
+    // device-local inputs.
+    VkMemoryBarrier prior{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    prior.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    prior.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(fs.uploadCmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &prior, 0, nullptr, 0, nullptr);
+
+    auto& regions = c->copyScratch;
+    regions.clear();
+    for (uint32_t i = 0; i < INPUT_COUNT; ++i) {
+        Input& in = c->in[i];
+        if (in.dirty.empty()) continue;
+        in.coalesce();
+        for (const Input::Span& sp : in.dirty)
+            for_each_staged(InputId(i), sp, [&regions](VkDeviceSize off, VkDeviceSize, VkDeviceSize len) {
+                regions.push_back({ off, off, len });
+            });
+        in.dirty.clear();
+    }
+    vkCmdCopyBuffer(fs.uploadCmd, fs.staging.buffer, c->state.buffer, uint32_t(regions.size()), regions.data());
+
+    VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    mb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(fs.uploadCmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &mb, 0, nullptr, 0, nullptr);
+}
+
+// Record the slot's per-frame update command buffer: the input copies, then
+// each prepass p for its nPre[p] sessions. Returns false (nothing recorded)
+// when there is neither.
+static bool record_update(AgbVkCtx* c, FrameSlot& fs, const uint32_t nPre[PREPASS_COUNT]) {
+    bool any = false, anyPre = false;
+    for (const Input& in : c->in) any |= !in.dirty.empty();
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p) anyPre |= nPre[p] != 0;
+    if (!any && !anyPre) return false;
+
+    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkCheck(vkBeginCommandBuffer(fs.uploadCmd, &bi), "vkBeginCommandBuffer");
+    if (any) record_copies(c, fs);
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p)
+        if (nPre[p]) record_prepass(c, PrepassId(p), fs.uploadCmd, fs.dset, (1 + p) * c->sessions, nPre[p]);
+    vkCheck(vkEndCommandBuffer(fs.uploadCmd), "vkEndCommandBuffer");
+    return true;
+}
+
+static void record_compose(AgbVkCtx* c, FrameSlot& fs, VkCommandBuffer cmd,
+    const std::array<uint32_t, 6>& pc, uint32_t layers, uint32_t output, VkPipeline pipe) {
+    // Recorded once, submitted many times: no ONE_TIME_SUBMIT.
+    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    vkCheck(vkBeginCommandBuffer(cmd, &bi), "vkBeginCommandBuffer");
+
+    if (output) {
+        // `composed` (and prevFrame) are shared: earlier frames may still
+        // write (WAW) or read (WAR) them.
+        VkMemoryBarrier prior{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        prior.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        prior.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &prior, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipe);
+    VkDescriptorSet composeSet = output ? fs.composedDset : fs.dset;
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pl, 0, 1, &composeSet, 0, nullptr);
+
+    // Push-constants layout matches your struct {fbW,fbH,mapW,mapH,objCharBase,objMapMode}. :contentReference[oaicite:19]{index=19}
+    vkCmdPushConstants(cmd, c->pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * 6, pc.data());
+
+    const uint32_t gx = (pc[0] + COMPOSE_WG_W - 1) / COMPOSE_WG_W;
+    const uint32_t gy = (pc[1] + COMPOSE_WG_H - 1) / COMPOSE_WG_H;
+    vkCmdDispatch(cmd, gx, gy, layers);
+
+    if (output) {
+        VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmd,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &mb, 0, nullptr, 0, nullptr);
+    }
+    if (output & OUTPUT_INFO) {
+        // Forwards the pixels to outBuf itself unless the reduce pass does.
+        const AgbVkCtx::OutputPass& ip = c->passes[PASS_INFO];
+        const uint32_t ipc[3] = { pc[0], pc[1], reduced(output) ? 0u : 1u };
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ip.pipe);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, ip.pl, 0, 1, &fs.passSet[PASS_INFO], 0, nullptr);
+        vkCmdPushConstants(cmd, ip.pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ipc), ipc);
+        vkCmdDispatch(cmd, (pc[0] + INFO_WG - 1) / INFO_WG, (pc[1] + INFO_WG - 1) / INFO_WG, layers);
+    }
+    if (upscale_factor(output)) {
+        // Forwards the 1x pixels unless the frame info or reduce pass does.
+        const AgbVkCtx::OutputPass& up = c->passes[PASS_UPSCALE];
+        const uint32_t upc[4] = { pc[0], pc[1], (output >> OUTPUT_UPSCALE_SHIFT) & 0xF,
+            (reduced(output) || (output & OUTPUT_INFO)) ? 0u : 1u };
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, up.pipe);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, up.pl, 0, 1, &fs.passSet[PASS_UPSCALE], 0, nullptr);
+        vkCmdPushConstants(cmd, up.pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(upc), upc);
+        vkCmdDispatch(cmd, (pc[0] + UPSCALE_WG - 1) / UPSCALE_WG, (pc[1] + UPSCALE_WG - 1) / UPSCALE_WG, layers);
+    }
+    if (reduced(output)) {
+        const AgbVkCtx::OutputPass& rp = c->passes[PASS_REDUCE];
+        const uint32_t rpc[4] = { pc[0], pc[1], output & OUTPUT_FORMAT_MASK, (output & OUTPUT_HALF) ? 1u : 0u };
+        const VkDeviceSize words = output_frame_bytes(pc[0], pc[1], output) / sizeof(uint32_t);
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, rp.pipe);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, rp.pl, 0, 1, &fs.passSet[PASS_REDUCE], 0, nullptr);
+        vkCmdPushConstants(cmd, rp.pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(rpc), rpc);
+        vkCmdDispatch(cmd, uint32_t((words + REDUCE_WG - 1) / REDUCE_WG), 1, layers);
+    }
+
+    // Ensure shader writes visible to host
+    VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    mb.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+        0, 1, &mb, 0, nullptr, 0, nullptr);
+
+    if (fs.timestamps) vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, fs.timestamps, 1);
+
+    vkCheck(vkEndCommandBuffer(cmd), "vkEndCommandBuffer");
+}
+
+// Cached compose command buffer for `pc`, re-recording the least recently
+// used entry on a miss. The slot is idle here, so none of them is pending.
+static VkCommandBuffer compose_cmd(AgbVkCtx* c, FrameSlot& fs, const std::array<uint32_t, 6>& pc,
+    uint32_t layers, uint32_t output, VkPipeline pipe) {
+    ComposeCmd* victim = &fs.compose[0];
+    for (ComposeCmd& cc : fs.compose) {
+        if (cc.lastUse != 0 && cc.pc == pc && cc.layers == layers && cc.output == output && cc.pipe == pipe) {
+            cc.lastUse = c->nextTicket;
+            return cc.cmd;
+        }
+        if (cc.lastUse < victim->lastUse) victim = &cc;
+    }
+    record_compose(c, fs, victim->cmd, pc, layers, output, pipe);
+    victim->pc = pc;
+    victim->layers = layers;
+    victim->output = output;
+    victim->pipe = pipe;
+    victim->lastUse = c->nextTicket;
+    return victim->cmd;
+}
+
+// Flag the sessions (layers of `layerBytes`) touched by `in`'s dirty spans.
+static void mark_stale(const Input& in, VkDeviceSize layerBytes, std::vector<uint8_t>& stale) {
+    for (const Input::Span& sp : in.dirty)
+        for (VkDeviceSize s = sp.lo / layerBytes; s <= (sp.hi - 1) / layerBytes; ++s)
+            stale[size_t(s)] = 1;
+}
+
+// Mirror this frame's writes to the shadowed inputs and flag the sessions they
+// touched, so their scene keys are recomputed.
+static void sync_shadows(AgbVkCtx* c, FrameSlot& fs) {
+    const uint8_t* staging = static_cast<const uint8_t*>(fs.staging.mapped);
+    for (uint32_t i = 0; i < INPUT_COUNT; ++i) {
+        Input& in = c->in[i];
+        if (in.shadow.empty()) continue;
+        for (const Input::Span& sp : in.dirty) {
+            for_each_staged(InputId(i), sp, [&](VkDeviceSize src, VkDeviceSize dst, VkDeviceSize len) {
+                std::memcpy(in.shadow.data() + dst, staging + src, size_t(len));
+            });
+            for (VkDeviceSize s = sp.lo / INPUT_BYTES[i]; s <= (sp.hi - 1) / INPUT_BYTES[i]; ++s)
+                c->sessionKeyStale[size_t(s)] = 1;
+        }
+    }
+}
+
+static SceneKey session_scene_key(AgbVkCtx* c, uint32_t s) {
+    if (c->sessionKeyStale[s]) {
+        auto at = [c, s](InputId id) { return c->in[id].shadow.data() + INPUT_BYTES[id] * s; };
+        c->sessionKey[s] = scene_key(reinterpret_cast<const BGParam*>(at(IN_BG_PARAMS)), at(IN_OAM),
+            *reinterpret_cast<const WinState*>(at(IN_WIN)), *reinterpret_cast<const FxRegs*>(at(IN_FX)),
+            reinterpret_cast<const Scanline*>(at(IN_SCAN)));
+        c->sessionKeyStale[s] = 0;
+    }
+    return c->sessionKey[s];
+}
+
+// Point the slot's set of output pass `id` (if made) at the current buffers,
+// in the binding order its shader declares.
+static void write_pass_set(AgbVkCtx* c, FrameSlot& fs, OutputPassId id) {
+    const VkDescriptorSet set = fs.passSet[id];
+    if (!set) return;
+    switch (id) {
+    case PASS_REDUCE:
+        write_buffers(c->dev, set, { &c->composed, &fs.layerMap, &fs.outBuf });
+        break;
+    case PASS_INFO:
+        write_buffers(c->dev, set, { &c->composed, &fs.layerMap, &fs.outBuf, &c->prevFrame, &fs.infoBuf });
+        break;
+    case PASS_UPSCALE:
+        // upBuf is made by the slot's first upscaled submit, which writes the set.
+        if (fs.upBuf.buffer)
+            write_buffers(c->dev, set, { &c->composed, &fs.layerMap, &fs.outBuf, &fs.upBuf });
+        break;
+    default:
+        break;
+    }
+}
+
+// Point every descriptor set of `fs` at the current buffers. The cached
+// compose command buffers bound the old ones, so they are dropped. `fs` must
+// be idle.
+static void write_slot_sets(AgbVkCtx* c, FrameSlot& fs) {
+    const Buffer* pre[PREPASS_COUNT];
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p) pre[p] = &c->pre[p].out;
+    write_dset(c->dev, fs.dset, fs.outBuf, c->state, fs.layerMap, pre);
+    if (fs.composedDset) write_dset(c->dev, fs.composedDset, c->composed, c->state, fs.layerMap, pre);
+    for (uint32_t p = 0; p < OUTPUT_PASS_COUNT; ++p) write_pass_set(c, fs, OutputPassId(p));
+    for (ComposeCmd& cc : fs.compose) cc.lastUse = 0;
+}
+
+// Grow the framebuffers a frame of fbW x fbH (upscaled by `factor`, 0 = none)
+// needs. The shared ones wait for every slot first; `fs` is idle already.
+// Buffers only grow, so alternating sizes settle after the largest.
+static void fit_framebuffers(AgbVkCtx* c, FrameSlot& fs, uint32_t fbW, uint32_t fbH, uint32_t factor) {
+    const VkBufferUsageFlags SSBO = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    const VkDeviceSize need = VkDeviceSize(fbW) * fbH * sizeof(uint32_t) * c->sessions;
+    if (need > c->fbBytes) {
+        c->fbBytes = need;
+        if (c->composed.buffer || c->prevFrame.buffer) {
+            for (FrameSlot& s : c->slots) wait_slot(c, s);
+            if (c->composed.buffer) {
+                c->composed.destroy();
+                c->composed.create(c->phys, c->dev, need, SSBO, MEM_SHADER);
+            }
+            if (c->prevFrame.buffer) {
+                c->prevFrame.destroy();
+                c->prevFrame.create(c->phys, c->dev, need, SSBO, MEM_SHADER);
+                std::fill(c->infoPrevValid.begin(), c->infoPrevValid.end(), uint8_t(0));
+            }
+            for (FrameSlot& s : c->slots) write_slot_sets(c, s);
+        }
+    }
+
+    bool grown = false;
+    if (fs.outBuf.size < need) {
+        if (fs.outBuf.hostImported) {
+            std::cerr << "agbvk: " << fbW << "x" << fbH << " frames do not fit the imported output memory;"
+                         " using internal memory for this frame slot\n";
+            c->outputImported = false;
+        }
+        fs.outBuf.destroy();
+        fs.outBuf.create(c->phys, c->dev, need, SSBO, MEM_READBACK);
+        c->roleType[MEM_READBACK] = int32_t(fs.outBuf.memType);
+        grown = true;
+    }
+    const VkDeviceSize upNeed = need * factor * factor;
+    if (fs.upBuf.size < upNeed) {
+        fs.upBuf.destroy();
+        fs.upBuf.create(c->phys, c->dev, upNeed, SSBO, MEM_READBACK);
+        c->roleType[MEM_READBACK] = int32_t(fs.upBuf.memType);
+        grown = true;
+    }
+    if (grown) write_slot_sets(c, fs);
+}
 
 // ---- Dispatch & readback -----------------------------------------------
+uint64_t agbvk_submit_frame(AgbVkCtx* c,
+    uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH,
+    uint32_t objCharBase, uint32_t objMapMode)
+{
+    FrameSlot& fs = acquire_slot(c);
+    if (fs.ticket && fs.ticket == c->acquiredTicket) {
+        if (!c->reuseWarned)
+            std::cerr << "agbvk: frame " << fs.ticket << " is still acquired but its slot is being reused\n";
+        c->reuseWarned = true;
+        c->acquiredTicket = 0;
+    }
+
+    const uint32_t output = c->output | (c->frameInfo ? OUTPUT_INFO : 0)
+        | (c->upscale << OUTPUT_UPSCALE_SHIFT);
+    fit_framebuffers(c, fs, fbW, fbH, upscale_factor(output));
+
+    // Sessions whose OAM changed need new OBJ bins; palette changes, a new LUT.
+    mark_stale(c->in[IN_OAM], OAM_BYTES, c->pre[PRE_OBJ_BINS].stale);
+    mark_stale(c->in[IN_PAL_BG], PAL_BG_BYTES, c->pre[PRE_PAL_LUT].stale);
+    mark_stale(c->in[IN_PAL_OBJ], PAL_OBJ_BYTES, c->pre[PRE_PAL_LUT].stale);
+
+    // Active sessions, in order, become dispatch layers 0..n-1; the stale
+    // ones among them are listed again from layerOf[(1+p)K] for prepass p.
+    auto& active = c->activeScratch;
+    active.clear();
+    for (uint32_t s = 0; s < c->sessions; ++s)
+        if (c->sessionActive[s]) active.push_back(s);
+    auto* map = static_cast<uint32_t*>(fs.layerMap.mapped);
+    uint32_t nPre[PREPASS_COUNT]{};
+    if (!active.empty()) {
+        std::memcpy(map, active.data(), active.size() * sizeof(uint32_t));
+        fs.layerMap.markDirty(0, active.size() * sizeof(uint32_t));
+        for (uint32_t p = 0; p < PREPASS_COUNT; ++p) {
+            uint32_t* list = map + (1 + p) * c->sessions;
+            for (uint32_t s : active) {
+                if (!c->pre[p].stale[s]) continue;
+                list[nPre[p]++] = s;
+                c->pre[p].stale[s] = 0;
+            }
+            fs.layerMap.markDirty((1 + p) * c->sessions * sizeof(uint32_t), nPre[p] * sizeof(uint32_t));
+        }
+        fs.layerMap.flushDirty();
+    }
+
+    // Make host writes visible to the device (no-op on coherent memory).
+    fs.staging.flushDirty();
+
+    // Frame info: reset the results of the sessions composed now and note
+    // which of them have a previous frame at this size to compare against.
+    if (!fs.infoState.empty()) std::fill(fs.infoState.begin(), fs.infoState.end(), uint8_t(0));
+    if (c->frameInfo) {
+        if (c->infoDims[0] != fbW || c->infoDims[1] != fbH) {
+            std::fill(c->infoPrevValid.begin(), c->infoPrevValid.end(), uint8_t(0));
+            c->infoDims = { fbW, fbH };
+        }
+        auto* words = static_cast<uint32_t*>(fs.infoBuf.mapped);
+        for (uint32_t s : active) {
+            static constexpr uint32_t INIT[INFO_WORDS] = { 0, 0, 0, 0, 0xFFFFFFFFu, 0xFFFFFFFFu, 0, 0 };
+            std::memcpy(words + s * INFO_WORDS, INIT, sizeof(INIT));
+            fs.infoBuf.markDirty(s * INFO_WORDS * sizeof(uint32_t), sizeof(INIT));
+            fs.infoState[s] = c->infoPrevValid[s] ? 1 : 2;
+            c->infoPrevValid[s] = 1;
+        }
+        fs.infoBuf.flushDirty();
+    }
+
+    // Scene features of the active sessions pick the pipeline variant.
+    const std::array<uint32_t, 6> pc{ fbW, fbH, mapW, mapH, objCharBase, objMapMode };
+    VkPipeline pipe = c->pipe;
+    if (c->variantsEnabled) sync_shadows(c, fs);
+    if (c->variantsEnabled && !active.empty()) {
+        SceneKey k = session_scene_key(c, active[0]);
+        for (size_t i = 1; i < active.size(); ++i) merge_scene_key(k, session_scene_key(c, active[i]));
+        pipe = pick_pipeline(c, k, pc);
+    }
+
+    // Per-frame copies and prepass (only if something changed) + the cached
+    // compose pass, bracketed by the slot's timestamps when there are any.
+    VkCommandBuffer cmds[3];
+    uint32_t nCmds = 0;
+    if (fs.tsBeginCmd) cmds[nCmds++] = fs.tsBeginCmd;
+    if (record_update(c, fs, nPre)) cmds[nCmds++] = fs.uploadCmd;
+    cmds[nCmds++] = compose_cmd(c, fs, pc, uint32_t(active.size()), output, pipe);
+
+    // Submit without waiting; the slot's fence tracks completion
+    vkCheck(vkResetFences(c->dev, 1, &fs.fence), "vkResetFences");
+    VkSubmitInfo si{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    si.commandBufferCount = nCmds; si.pCommandBuffers = cmds;
+    vkCheck(vkQueueSubmit(c->queue, 1, &si, fs.fence), "vkQueueSubmit");
+
+    c->lastPc = pc;
+    fs.ticket = c->nextTicket++;
+    fs.output = output;
+    fs.fbDims = { fbW, fbH };
+    fs.pending = true;
+    c->cur = (c->cur + 1) % uint32_t(c->slots.size());
+    return fs.ticket;
+}
+
+void agbvk_wait_frame(AgbVkCtx* c, uint64_t ticket) {
+    if (ticket == 0 || ticket >= c->nextTicket) return;
+    FrameSlot& fs = slot_of(c, ticket);
+    if (fs.ticket == ticket) wait_slot(c, fs);
+}
+
+// Slot of a finished `ticket` (polling its fence), or null with *status set
+// to 0 (still executing) or -1 (unknown ticket or slot already reused).
+static FrameSlot* finished_slot(AgbVkCtx* c, uint64_t ticket, int* status) {
+    *status = -1;
+    if (ticket == 0 || ticket >= c->nextTicket) return nullptr;
+    FrameSlot& fs = slot_of(c, ticket);
+    if (fs.ticket != ticket) return nullptr;
+    if (fs.pending) {
+        VkResult r = vkGetFenceStatus(c->dev, fs.fence);
+        if (r == VK_NOT_READY) { *status = 0; return nullptr; }
+        vkCheck(r, "vkGetFenceStatus");
+        fs.pending = false;
+    }
+    *status = 1;
+    return &fs;
+}
+
+int agbvk_try_readback(AgbVkCtx* c, uint64_t ticket, uint32_t* dstRGBA, size_t pixelCount) {
+    int status;
+    FrameSlot* slot = finished_slot(c, ticket, &status);
+    if (!slot) return status;
+    FrameSlot& fs = *slot;
+    // NOTE: outBuf holds at least fbW*fbH pixels per session of the latest
+    // submits; callers pass pixelCount=fbW*fbH. With several sessions their
+    // framebuffers follow each other, so a larger pixelCount reads them all
+    // (see agbvk_session_offset).
+    const size_t bytes = size_t(std::min<VkDeviceSize>(pixelCount * sizeof(uint32_t), fs.outBuf.size));
+    fs.outBuf.invalidate(0, bytes);
+    std::memcpy(dstRGBA, fs.outBuf.mapped, bytes);
+    return 1;
+}
+
+int agbvk_gpu_time_ns(AgbVkCtx* c, uint64_t ticket, uint64_t* ns) {
+    int status;
+    FrameSlot* fs = finished_slot(c, ticket, &status);
+    if (!fs) return status;
+    if (!fs->timestamps) return -1;
+    uint64_t ts[2]{};
+    if (vkGetQueryPoolResults(c->dev, fs->timestamps, 0, 2, sizeof(ts), ts, sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) return -1;
+    const uint64_t mask = c->tsValidBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << c->tsValidBits) - 1;
+    *ns = uint64_t(double((ts[1] - ts[0]) & mask) * c->tsPeriod);
+    return 1;
+}
+
 void agbvk_dispatch_frame(AgbVkCtx* c,
     uint32_t fbW, uint32_t fbH,
     uint32_t mapW, uint32_t mapH,
     uint32_t objCharBase, uint32_t objMapMode)
 {
-    // Record fresh each call (simple, mirrors your single-shot recording).  :contentReference[oaicite:18]{index=18}
-    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    vkCheck(vkBeginCommandBuffer(c->cmd, &bi), "vkBeginCommandBuffer");
+    agbvk_wait_frame(c, agbvk_submit_frame(c, fbW, fbH, mapW, mapH, objCharBase, objMapMode));
+}
 
-    vkCmdBindPipeline(c->cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pipe);
-    vkCmdBindDescriptorSets(c->cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pl, 0, 1, &c->dset, 0, nullptr);
+void agbvk_readback_rgba(AgbVkCtx* c, uint32_t* dstRGBA, size_t pixelCount) {
+    // Most recently submitted frame; waits for it if still executing.
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return;
+    agbvk_wait_frame(c, last);
+    agbvk_try_readback(c, last, dstRGBA, pixelCount);
+}
 
-    // Push-constants layout matches your struct {fbW,fbH,mapW,mapH,objCharBase,objMapMode}. :contentReference[oaicite:19]{index=19}
-    uint32_t pc[6] = { fbW, fbH, mapW, mapH, objCharBase, objMapMode };
-    vkCmdPushConstants(c->cmd, c->pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), pc);
+void agbvk_readback_rect(AgbVkCtx* c, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride) {
+    const uint64_t last = c->nextTicket - 1;
+    const uint32_t fbW = c->lastPc[0], fbH = c->lastPc[1];
+    if (last == 0 || x >= fbW || y >= fbH) return;
+    w = std::min(w, fbW - x);
+    h = std::min(h, fbH - y);
+    if (w == 0 || h == 0) return;
+    agbvk_wait_frame(c, last);
+    FrameSlot& fs = slot_of(c, last);
 
-    const uint32_t gx = (fbW + 7) / 8;
-    const uint32_t gy = (fbH + 7) / 8;
-    vkCmdDispatch(c->cmd, gx, gy, 1);                                           // :contentReference[oaicite:20]{index=20}
+    // Only the rows the rectangle spans are invalidated and touched.
+    const VkDeviceSize base = VkDeviceSize(agbvk_session_offset(c, c->session)) * sizeof(uint32_t);
+    const VkDeviceSize lo = base + (VkDeviceSize(y) * fbW + x) * sizeof(uint32_t);
+    const VkDeviceSize hi = base + (VkDeviceSize(y + h - 1) * fbW + x + w) * sizeof(uint32_t);
+    if (hi > fs.outBuf.size) return;
+    fs.outBuf.invalidate(lo, hi - lo);
+    const uint8_t* src = static_cast<const uint8_t*>(fs.outBuf.mapped) + lo;
+    for (uint32_t row = 0; row < h; ++row)
+        std::memcpy(dst + row * dstStride, src + VkDeviceSize(row) * fbW * sizeof(uint32_t), w * sizeof(uint32_t));
+}
+
+// ---- Output passes -----------------------------------------------------
+// Compile output pass `id` (`bindings` storage buffers in one set, `pushWords`
+// u32 push constants) and give every slot its set. The buffers the set points
+// at must exist; in-flight frames are unaffected since only new sets are written.
+static void ensure_pass(AgbVkCtx* c, OutputPassId id, const unsigned char* spv, size_t spvSize,
+    uint32_t bindings, uint32_t pushWords) {
+    AgbVkCtx::OutputPass& p = c->passes[id];
+    if (p.pipe) return;
+
+    VkDescriptorSetLayoutBinding binds[BINDING_COUNT]{};
+    for (uint32_t i = 0; i < bindings; ++i) {
+        binds[i].binding = i;
+        binds[i].descriptorCount = 1;
+        binds[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binds[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo dsli{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    dsli.bindingCount = bindings; dsli.pBindings = binds;
+    vkCheck(vkCreateDescriptorSetLayout(c->dev, &dsli, nullptr, &p.dsl), "vkCreateDescriptorSetLayout");
+
+    VkPushConstantRange pcr{ VK_SHADER_STAGE_COMPUTE_BIT, 0, uint32_t(sizeof(uint32_t) * pushWords) };
+    VkPipelineLayoutCreateInfo plci{ VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    plci.setLayoutCount = 1; plci.pSetLayouts = &p.dsl;
+    plci.pushConstantRangeCount = 1; plci.pPushConstantRanges = &pcr;
+    vkCheck(vkCreatePipelineLayout(c->dev, &plci, nullptr, &p.pl), "vkCreatePipelineLayout");
+
+    p.shader = createShaderModule(c->dev, spv, spvSize);
+    VkComputePipelineCreateInfo cpci{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    cpci.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    cpci.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT; cpci.stage.module = p.shader; cpci.stage.pName = "main";
+    cpci.layout = p.pl;
+    vkCheck(vkCreateComputePipelines(c->dev, c->pipeCache, 1, &cpci, nullptr, &p.pipe), "vkCreateComputePipelines");
+
+    for (FrameSlot& fs : c->slots) {
+        VkDescriptorSetAllocateInfo dsai{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        dsai.descriptorPool = c->pool; dsai.descriptorSetCount = 1; dsai.pSetLayouts = &p.dsl;
+        vkCheck(vkAllocateDescriptorSets(c->dev, &dsai, &fs.passSet[id]), "vkAllocateDescriptorSets");
+        write_pass_set(c, fs, id);
+    }
+}
+
+// ---- Reduced output ----------------------------------------------------
+// Create the shared device-local framebuffer and point every slot's
+// composedDset at it; nothing uses either before the first submit that needs them.
+static void ensure_composed(AgbVkCtx* c) {
+    if (c->composed.buffer) return;
+    c->composed.create(c->phys, c->dev, c->fbBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEM_SHADER);
+    const Buffer* pre[PREPASS_COUNT];
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p) pre[p] = &c->pre[p].out;
+    for (FrameSlot& fs : c->slots) {
+        VkDescriptorSetAllocateInfo dsai{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        dsai.descriptorPool = c->pool; dsai.descriptorSetCount = 1; dsai.pSetLayouts = &c->dsl;
+        vkCheck(vkAllocateDescriptorSets(c->dev, &dsai, &fs.composedDset), "vkAllocateDescriptorSets");
+        write_dset(c->dev, fs.composedDset, c->composed, c->state, fs.layerMap, pre);
+    }
+}
+
+void agbvk_set_output(AgbVkCtx* c, AgbVkOutputFormat format, int halfSize) {
+    if (uint32_t(format) > AGBVK_OUTPUT_BGR555) return;
+    c->output = uint32_t(format) | (halfSize ? OUTPUT_HALF : 0);
+    if (c->output) {
+        ensure_composed(c);
+        // {fbW, fbH, format, halfSize}
+        ensure_pass(c, PASS_REDUCE, agbvk_reduce_frame_spv, agbvk_reduce_frame_spv_size, 3, 4);
+    }
+}
+
+// ---- Frame info --------------------------------------------------------
+void agbvk_set_frame_info(AgbVkCtx* c, int enabled) {
+    if (enabled && !c->prevFrame.buffer) {
+        ensure_composed(c);
+        c->prevFrame.create(c->phys, c->dev, c->fbBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEM_SHADER);
+        c->infoPrevValid.assign(c->sessions, 0);
+        for (FrameSlot& fs : c->slots) {
+            fs.infoBuf.create(c->phys, c->dev, VkDeviceSize(INFO_WORDS) * sizeof(uint32_t) * c->sessions,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MEM_READBACK);
+            c->roleType[MEM_READBACK] = int32_t(fs.infoBuf.memType);
+            fs.infoState.assign(c->sessions, 0);
+        }
+        // {fbW, fbH, copyOut}
+        ensure_pass(c, PASS_INFO, agbvk_frame_info_spv, agbvk_frame_info_spv_size, 5, 3);
+    }
+    // prevFrame is not kept up to date while the pass is off.
+    if (enabled && !c->frameInfo) std::fill(c->infoPrevValid.begin(), c->infoPrevValid.end(), uint8_t(0));
+    c->frameInfo = enabled != 0;
+}
+
+int agbvk_frame_info(AgbVkCtx* c, uint64_t ticket, uint32_t session, AgbVkFrameInfo* out) {
+    int status;
+    FrameSlot* fs = finished_slot(c, ticket, &status);
+    if (!fs) return status;
+    if (session >= fs->infoState.size() || fs->infoState[session] == 0) return -1;
+    const VkDeviceSize off = VkDeviceSize(session) * INFO_WORDS * sizeof(uint32_t);
+    fs->infoBuf.invalidate(off, INFO_WORDS * sizeof(uint32_t));
+    const uint32_t* w = static_cast<const uint32_t*>(fs->infoBuf.mapped) + session * INFO_WORDS;
+    *out = AgbVkFrameInfo{};
+    out->hash = (uint64_t(w[1]) << 32) | w[0];
+    const uint32_t fbW = fs->fbDims[0], fbH = fs->fbDims[1];
+    if (fs->infoState[session] == 2) {
+        out->changedPixels = fbW * fbH;
+        if (out->changedPixels) { out->maxX = fbW - 1; out->maxY = fbH - 1; }
+    } else if (w[2]) {
+        out->changedPixels = w[2];
+        out->minX = w[4]; out->minY = w[5];
+        out->maxX = w[6]; out->maxY = w[7];
+    }
+    return 1;
+}
+
+size_t agbvk_output_frame_bytes(AgbVkCtx* c) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return 0;
+    return size_t(output_frame_bytes(c->lastPc[0], c->lastPc[1], slot_of(c, last).output));
+}
+
+size_t agbvk_readback_output(AgbVkCtx* c, void* dst, size_t dstBytes) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return 0;
+    agbvk_wait_frame(c, last);
+    FrameSlot& fs = slot_of(c, last);
+    const VkDeviceSize frame = output_frame_bytes(c->lastPc[0], c->lastPc[1], fs.output);
+    const size_t bytes = size_t(std::min<VkDeviceSize>({ frame * c->sessions, fs.outBuf.size, dstBytes }));
+    fs.outBuf.invalidate(0, bytes);
+    std::memcpy(dst, fs.outBuf.mapped, bytes);
+    return bytes;
+}
+
+// ---- Upscaled output ---------------------------------------------------
+// The pass is compiled here; a slot's upBuf is made by the first submit that
+// needs it.
+void agbvk_set_upscale(AgbVkCtx* c, AgbVkUpscale mode) {
+    if (uint32_t(mode) > AGBVK_UPSCALE_SCALE2X) return;
+    c->upscale = uint32_t(mode);
+    if (c->upscale) {
+        ensure_composed(c);
+        // {fbW, fbH, mode, copyOut}
+        ensure_pass(c, PASS_UPSCALE, agbvk_upscale_frame_spv, agbvk_upscale_frame_spv_size, 4, 4);
+    }
+}
+
+int agbvk_acquire_upscaled(AgbVkCtx* c, const uint32_t** pixels, uint32_t* w, uint32_t* h) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return 0;
+    FrameSlot& fs = slot_of(c, last);
+    const uint32_t f = upscale_factor(fs.output);
+    if (!f) return 0;
+    agbvk_wait_frame(c, last);
+    const VkDeviceSize bytes = VkDeviceSize(fs.fbDims[0]) * fs.fbDims[1] * f * f * sizeof(uint32_t) * c->sessions;
+    fs.upBuf.invalidate(0, std::min(bytes, fs.upBuf.size));
+    *pixels = static_cast<const uint32_t*>(fs.upBuf.mapped);
+    *w = fs.fbDims[0] * f;
+    *h = fs.fbDims[1] * f;
+    c->acquiredTicket = last;
+    return 1;
+}
+
+size_t agbvk_readback_upscaled(AgbVkCtx* c, uint32_t* dst, size_t pixelCount) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return 0;
+    FrameSlot& fs = slot_of(c, last);
+    const uint32_t f = upscale_factor(fs.output);
+    if (!f) return 0;
+    agbvk_wait_frame(c, last);
+    const VkDeviceSize frame = VkDeviceSize(fs.fbDims[0]) * fs.fbDims[1] * f * f * sizeof(uint32_t);
+    const size_t bytes = size_t(std::min<VkDeviceSize>({ frame * c->sessions, fs.upBuf.size,
+        VkDeviceSize(pixelCount) * sizeof(uint32_t) }));
+    fs.upBuf.invalidate(0, bytes);
+    std::memcpy(dst, fs.upBuf.mapped, bytes);
+    return bytes / sizeof(uint32_t);
+}
+
+// ---- Zero-copy readback ------------------------------------------------
+int agbvk_acquire_frame(AgbVkCtx* c, const uint32_t** pixels, size_t* stride) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0) return 0;
+    FrameSlot& fs = slot_of(c, last);
+    if (reduced(fs.output)) return 0;   // packed output: agbvk_readback_output
+    agbvk_wait_frame(c, last);
+    const VkDeviceSize bytes = VkDeviceSize(agbvk_session_offset(c, c->sessions)) * sizeof(uint32_t);
+    fs.outBuf.invalidate(0, std::min(bytes, fs.outBuf.size));
+    *pixels = static_cast<const uint32_t*>(fs.outBuf.mapped);
+    *stride = c->lastPc[0];
+    c->acquiredTicket = last;
+    return 1;
+}
+
+void agbvk_release_frame(AgbVkCtx* c) { c->acquiredTicket = 0; }
+
+int agbvk_output_imported(AgbVkCtx* c) { return c->outputImported ? 1 : 0; }
+
+// ---- Sessions ----------------------------------------------------------
+uint32_t agbvk_session_count(AgbVkCtx* c) { return c->sessions; }
+
+void agbvk_select_session(AgbVkCtx* c, uint32_t session) {
+    if (session < c->sessions) c->session = session;
+}
+
+void agbvk_set_session_active(AgbVkCtx* c, uint32_t session, int active) {
+    if (session < c->sessions) c->sessionActive[session] = active ? 1 : 0;
+}
+
+size_t agbvk_session_offset(AgbVkCtx* c, uint32_t session) {
+    // Framebuffers are indexed by session id at the latest submit's size.
+    return size_t(session) * c->lastPc[0] * c->lastPc[1];
+}
+
+void agbvk_readback_session(AgbVkCtx* c, uint32_t session, uint32_t* dstRGBA, size_t pixelCount) {
+    const uint64_t last = c->nextTicket - 1;
+    if (last == 0 || session >= c->sessions) return;
+    agbvk_wait_frame(c, last);
+    FrameSlot& fs = slot_of(c, last);
+    const VkDeviceSize off = VkDeviceSize(agbvk_session_offset(c, session)) * sizeof(uint32_t);
+    if (off >= fs.outBuf.size) return;
+    const size_t bytes = size_t(std::min<VkDeviceSize>(pixelCount * sizeof(uint32_t), fs.outBuf.size - off));
+    fs.outBuf.invalidate(off, bytes);
+    std::memcpy(dstRGBA, static_cast<const uint8_t*>(fs.outBuf.mapped) + off, bytes);
+}
+
+// ---- Memory types ------------------------------------------------------
+static_assert(uint32_t(AGBVK_MEMORY_SHADER) == MEM_SHADER && uint32_t(AGBVK_MEMORY_UPLOAD) == MEM_UPLOAD &&
+    uint32_t(AGBVK_MEMORY_READBACK) == MEM_READBACK && uint32_t(AGBVK_MEMORY_ROLE_COUNT) == MEM_ROLE_COUNT,
+    "AgbVkMemoryRole must match MemRole");
+
+static void memory_type_info(AgbVkCtx* c, uint32_t type, AgbVkMemoryInfo* out) {
+    VkPhysicalDeviceMemoryProperties mp{};
+    vkGetPhysicalDeviceMemoryProperties(c->phys, &mp);
+    const VkMemoryType& t = mp.memoryTypes[type];
+    out->typeIndex = type;
+    out->heapIndex = t.heapIndex;
+    out->propertyFlags = t.propertyFlags;
+    out->heapSize = mp.memoryHeaps[t.heapIndex].size;
+}
+
+int agbvk_memory_info(AgbVkCtx* c, AgbVkMemoryRole role, AgbVkMemoryInfo* out) {
+    if (uint32_t(role) >= MEM_ROLE_COUNT || c->roleType[role] < 0) return 0;
+    memory_type_info(c, uint32_t(c->roleType[role]), out);
+    return 1;
+}
+
+int agbvk_imported_memory_info(AgbVkCtx* c, AgbVkMemoryInfo* out) {
+    if (c->importedType < 0) return 0;
+    memory_type_info(c, uint32_t(c->importedType), out);
+    return 1;
+}
+
+// ---- Batch rendering ---------------------------------------------------
+static void destroy_batch_buffers(Batch& b) {
+    b.state.destroy();
+    for (Buffer& buf : b.pre) buf.destroy();
+    b.deviceMem.destroy();
+    b.staging.destroy();
+    b.layerMap.destroy();
+    b.uploadMem.destroy();
+    b.out.destroy();
+}
+
+// (Re)create the layered buffers for `layers` states at the given framebuffer
+// size. The batch fence has been waited on, so nothing here is in use.
+static void ensure_batch(AgbVkCtx* c, uint32_t layers, VkDeviceSize outLayerBytes) {
+    Batch& b = c->batch;
+    if (b.layers >= layers && b.outLayerBytes == outLayerBytes) return;
+    if (b.layers > layers) layers = b.layers;
+
+    const VkBufferUsageFlags SSBO = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    destroy_batch_buffers(b);
+    b.deviceMem.create(c->phys, c->dev, {
+        { &b.state, STATE_BYTES * layers, SSBO | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+        { &b.pre[PRE_OBJ_BINS], PREPASS_BYTES[PRE_OBJ_BINS] * layers, SSBO },
+        { &b.pre[PRE_PAL_LUT], PREPASS_BYTES[PRE_PAL_LUT] * layers, SSBO },
+    }, MEM_SHADER);
+    b.uploadMem.create(c->phys, c->dev, {
+        { &b.staging, STATE_BYTES * layers, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+        { &b.layerMap, layers * sizeof(uint32_t), SSBO },
+    }, MEM_UPLOAD);
+    b.out.create(c->phys, c->dev, outLayerBytes * layers, SSBO, MEM_READBACK);
+    c->roleType[MEM_READBACK] = int32_t(b.out.memType);
+    const Buffer* pre[PREPASS_COUNT];
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p) pre[p] = &b.pre[p];
+    auto* map = static_cast<uint32_t*>(b.layerMap.mapped);
+    for (uint32_t k = 0; k < layers; ++k) map[k] = k;
+    b.layerMap.markDirty(0, layers * sizeof(uint32_t));
+    b.layerMap.flushDirty();
+    b.layers = layers;
+    b.outLayerBytes = outLayerBytes;
+
+    if (!b.dset) {
+        VkDescriptorSetAllocateInfo dsai{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+        dsai.descriptorPool = c->pool; dsai.descriptorSetCount = 1; dsai.pSetLayouts = &c->dsl;
+        vkCheck(vkAllocateDescriptorSets(c->dev, &dsai, &b.dset), "vkAllocateDescriptorSets");
+
+        VkCommandBufferAllocateInfo cbai{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+        cbai.commandPool = c->cmdPool; cbai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; cbai.commandBufferCount = 1;
+        vkCheck(vkAllocateCommandBuffers(c->dev, &cbai, &b.cmd), "vkAllocateCommandBuffers");
+
+        VkFenceCreateInfo fci{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+        vkCheck(vkCreateFence(c->dev, &fci, nullptr, &b.fence), "vkCreateFence");
+    }
+    write_dset(c->dev, b.dset, b.out, b.state, b.layerMap, pre);
+}
+
+// Upload, compose and read back `n` (<= b.layers) states with one submit.
+static void render_chunk(AgbVkCtx* c, const AgbHwState* states, uint32_t n, uint32_t* outRGBA) {
+    Batch& b = c->batch;
+    const VkDeviceSize stateBytes = STATE_BYTES * n;
+    std::memcpy(b.staging.mapped, states, size_t(stateBytes));
+    b.staging.markDirty(0, stateBytes);
+    b.staging.flushDirty();
+
+    VkCommandBufferBeginInfo bi{ VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkCheck(vkBeginCommandBuffer(b.cmd, &bi), "vkBeginCommandBuffer");
+
+    VkBufferCopy region{ 0, 0, stateBytes };
+    vkCmdCopyBuffer(b.cmd, b.staging.buffer, b.state.buffer, 1, &region);
+    VkMemoryBarrier up{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    up.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    up.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(b.cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &up, 0, nullptr, 0, nullptr);
+    for (uint32_t p = 0; p < PREPASS_COUNT; ++p) record_prepass(c, PrepassId(p), b.cmd, b.dset, 0, n);
+
+    const std::array<uint32_t, 6>& pc = c->lastPc;
+    VkPipeline pipe = c->pipe;
+    if (c->variantsEnabled) {
+        SceneKey k = scene_key(states[0].bg_params, states[0].oam, states[0].win, states[0].fx, states[0].scan);
+        for (uint32_t i = 1; i < n; ++i)
+            merge_scene_key(k, scene_key(states[i].bg_params, states[i].oam, states[i].win, states[i].fx, states[i].scan));
+        pipe = pick_pipeline(c, k, pc);
+    }
+    vkCmdBindPipeline(b.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipe);
+    vkCmdBindDescriptorSets(b.cmd, VK_PIPELINE_BIND_POINT_COMPUTE, c->pl, 0, 1, &b.dset, 0, nullptr);
+    vkCmdPushConstants(b.cmd, c->pl, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) * 6, pc.data());
+    vkCmdDispatch(b.cmd, (pc[0] + COMPOSE_WG_W - 1) / COMPOSE_WG_W, (pc[1] + COMPOSE_WG_H - 1) / COMPOSE_WG_H, n);   // one z layer per state
 
-    // Ensure shader writes visible to host
     VkMemoryBarrier mb{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
     mb.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
     mb.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
-    vkCmdPipelineBarrier(c->cmd,
+    vkCmdPipelineBarrier(b.cmd,
         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
         0, 1, &mb, 0, nullptr, 0, nullptr);
+    vkCheck(vkEndCommandBuffer(b.cmd), "vkEndCommandBuffer");
 
-    vkCheck(vkEndCommandBuffer(c->cmd), "vkEndCommandBuffer");
-
-    // Submit + wait (reuse fence)
-    vkCheck(vkResetFences(c->dev, 1, &c->fence), "vkResetFences");
+    vkCheck(vkResetFences(c->dev, 1, &b.fence), "vkResetFences");
     VkSubmitInfo si{ VK_STRUCTURE_TYPE_SUBMIT_INFO };
-    si.commandBufferCount = 1; si.pCommandBuffers = &c->cmd;
-    vkCheck(vkQueueSubmit(c->queue, 1, &si, c->fence), "vkQueueSubmit");
-    vkCheck(vkWaitForFences(c->dev, 1, &c->fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+    si.commandBufferCount = 1; si.pCommandBuffers = &b.cmd;
+    vkCheck(vkQueueSubmit(c->queue, 1, &si, b.fence), "vkQueueSubmit");
+    vkCheck(vkWaitForFences(c->dev, 1, &b.fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+
+    const VkDeviceSize bytes = b.outLayerBytes * n;
+    b.out.invalidate(0, bytes);
+    std::memcpy(outRGBA, b.out.mapped, size_t(bytes));
 }
 
-void agbvk_readback_rgba(AgbVkCtx* c, uint32_t* dstRGBA, size_t pixelCount) {
-    // NOTE: outBuf was sized for 240x160 like your sample; callers should pass pixelCount=fbW*fbH (240*160).  :contentReference[oaicite:21]{index=21}
-    const size_t bytes = pixelCount * sizeof(uint32_t);
-    void* p = c->outBuf.map();
-    std::memcpy(dstRGBA, p, bytes);
-    c->outBuf.unmap();
+void agbvk_render_batch(AgbVkCtx* c, const AgbHwState* states, size_t n, uint32_t* outRGBA) {
+    if (n == 0) return;
+    const VkDeviceSize outLayerBytes = VkDeviceSize(c->lastPc[0]) * c->lastPc[1] * sizeof(uint32_t);
+    const size_t pixels = size_t(c->lastPc[0]) * c->lastPc[1];
+    ensure_batch(c, uint32_t(std::min<size_t>(n, MAX_BATCH_LAYERS)), outLayerBytes);
+
+    for (size_t done = 0; done < n; ) {
+        const uint32_t k = uint32_t(std::min<size_t>(n - done, c->batch.layers));
+        render_chunk(c, states + done, k, outRGBA + done * pixels);
+        done += k;
+    }
 }
 
 void agbvk_destroy(AgbVkCtx* c) {
     if (!c) return;
 
-    vkDestroyFence(c->dev, c->fence, nullptr);
+    vkDeviceWaitIdle(c->dev);
+
+    if (c->batch.fence) vkDestroyFence(c->dev, c->batch.fence, nullptr);
+    destroy_batch_buffers(c->batch);
+
+    for (FrameSlot& fs : c->slots) {
+        vkDestroyFence(c->dev, fs.fence, nullptr);
+        if (fs.timestamps) vkDestroyQueryPool(c->dev, fs.timestamps, nullptr);
+        fs.outBuf.destroy();
+        fs.infoBuf.destroy();
+        fs.upBuf.destroy();
+        fs.layerMap.destroy();
+        fs.staging.destroy();
+        fs.uploadMem.destroy();
+    }
     vkDestroyCommandPool(c->dev, c->cmdPool, nullptr);
 
     vkDestroyDescriptorPool(c->dev, c->pool, nullptr);
+    if (c->compiler.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(c->variantMtx);
+            c->compilerQuit = true;
+        }
+        c->variantCv.notify_one();
+        c->compiler.join();
+    }
+    for (auto& v : c->variants) vkDestroyPipeline(c->dev, v.second, nullptr);
     vkDestroyPipeline(c->dev, c->pipe, nullptr);
+    for (auto& pp : c->pre) vkDestroyPipeline(c->dev, pp.pipe, nullptr);
+    if (!c->pipeCachePath.empty()) {
+        size_t n = 0;
+        if (vkGetPipelineCacheData(c->dev, c->pipeCache, &n, nullptr) == VK_SUCCESS && n > 0) {
+            std::vector<char> blob(n);
+            if (vkGetPipelineCacheData(c->dev, c->pipeCache, &n, blob.data()) == VK_SUCCESS) {
+                blob.resize(n);
+                writeFileReplace(c->pipeCachePath, blob);
+            }
+        }
+    }
+    vkDestroyPipelineCache(c->dev, c->pipeCache, nullptr);
     vkDestroyShaderModule(c->dev, c->shader, nullptr);
+    for (auto& pp : c->pre) vkDestroyShaderModule(c->dev, pp.shader, nullptr);
     vkDestroyPipelineLayout(c->dev, c->pl, nullptr);
+    vkDestroyPipelineLayout(c->dev, c->prePl, nullptr);
     vkDestroyDescriptorSetLayout(c->dev, c->dsl, nullptr);
+    for (auto& op : c->passes) {
+        vkDestroyPipeline(c->dev, op.pipe, nullptr);
+        vkDestroyShaderModule(c->dev, op.shader, nullptr);
+        vkDestroyPipelineLayout(c->dev, op.pl, nullptr);
+        vkDestroyDescriptorSetLayout(c->dev, op.dsl, nullptr);
+    }
 
-    c->outBuf.destroy();
-    c->vramBuf.destroy();
-    c->palBuf.destroy();
-    c->bgBuf.destroy();
-    c->palObjBuf.destroy();
-    c->oamBuf.destroy();
-    c->winBuf.destroy();
-    c->fxBuf.destroy();
-    c->scanBuf.destroy();
-    c->affBuf.destroy();
-    c->objAffBuf.destroy();
+    c->state.destroy();
+    for (auto& pp : c->pre) pp.out.destroy();
+    c->deviceMem.destroy();
+    c->composed.destroy();
+    c->prevFrame.destroy();
 
     vkDestroyDevice(c->dev, nullptr);
     vkDestroyInstance(c->instance, nullptr);
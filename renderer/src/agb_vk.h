@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #if defined(__cplusplus)
 #include <cstddef>
@@ -10,14 +10,29 @@ extern "C" {
 #endif
 
 typedef struct AgbVkCtx AgbVkCtx;            // Opaque renderer context
+typedef struct AgbHwState AgbHwState;        // Host-side GBA state (agb_hw_state.h)
+
+// Creation options; zero-initialize and set only what you need.
+typedef struct AgbVkConfig {
+    uint32_t framesInFlight;   // frames that may be queued/executing at once (0 = default 2, max 8)
+    uint32_t sessions;         // independent GBA screens composed per dispatch (0 = 1, max 1024)
+    const char* pipelineCachePath; // VkPipelineCache file, loaded at create and saved at destroy
+                                   // (NULL = $AGBVK_PIPELINE_CACHE if set, else not persisted)
+    uint32_t noShaderVariants; // nonzero: always use the general shader (no per-scene specialization)
+    void* const* outputMemory; // one caller buffer per frame slot (framesInFlight after the default),
+                               // imported as the output framebuffers (VK_EXT_external_memory_host)
+                               // so frames are composed straight into them; NULL = allocate internally
+    size_t outputMemoryBytes;  // size of each outputMemory buffer
+} AgbVkConfig;
 
 // ---- Lifecycle ----
-AgbVkCtx* agbvk_create(void);
+AgbVkCtx* agbvk_create(void);                            // default config
+AgbVkCtx* agbvk_create_with(const AgbVkConfig* cfg);     // cfg may be NULL
 void      agbvk_destroy(AgbVkCtx* ctx);
 
-// ---- Upload endpoints (mirror the 11 SSBOs) ----
-// Byte-stream inputs are in the GBA/native layout; the implementation expands to
-// the SSBO layout (e.g., "uint-per-byte").
+// ---- Upload endpoints (sections of the state buffer, see agb_state_layout.h) ----
+// Byte-stream inputs are in the GBA/native layout and are copied verbatim; the
+// shader reads VRAM/palettes/OAM as packed little-endian bytes (4 per uint).
 
 void agbvk_upload_vram(AgbVkCtx*, const void* bytes, size_t countBytes);   // 96 KB bytes
 void agbvk_upload_pal_bg(AgbVkCtx*, const void* bytes, size_t countBytes);   // 1 KB  bytes
@@ -30,15 +45,228 @@ void agbvk_upload_scanline(AgbVkCtx*, const void* bytes, size_t countBytes);   /
 void agbvk_upload_bg_aff(AgbVkCtx*, const int32_t* i32, size_t countI32);     // 4*6  ints
 void agbvk_upload_obj_aff(AgbVkCtx*, const int32_t* i32, size_t countI32);     // 32*4 ints
 
+// ---- Range upload endpoints ----
+// Overwrite `countBytes` bytes starting at byte `offset` of the matching input;
+// the rest of the input keeps its previously uploaded contents. Only the
+// written bytes are copied to the GPU at the next dispatch.
+void agbvk_upload_vram_range(AgbVkCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbvk_upload_pal_bg_range(AgbVkCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbvk_upload_pal_obj_range(AgbVkCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbvk_upload_oam_range(AgbVkCtx*, size_t offset, const void* bytes, size_t countBytes);
+void agbvk_upload_scanline_range(AgbVkCtx*, size_t offset, const void* bytes, size_t countBytes);
+
+// ---- Direct-write endpoints ----
+// Inputs are staged through per-frame buffers that are mapped once in
+// agbvk_create and stay mapped until agbvk_destroy. These return the frame
+// being built's staging slice for an input, in the same layout the matching
+// upload_* call accepts, so callers can write it without an intermediate copy.
+// The slice does not hold the previous frame's data: write the whole input.
+// The pointer is valid until the next submit.
+void*     agbvk_map_vram(AgbVkCtx*);        // 96 KB bytes
+void*     agbvk_map_pal_bg(AgbVkCtx*);      // 1 KB  bytes
+uint32_t* agbvk_map_bg_params(AgbVkCtx*);   // 32 dwords
+void*     agbvk_map_pal_obj(AgbVkCtx*);     // 512  bytes
+void*     agbvk_map_oam(AgbVkCtx*);         // 1 KB  bytes
+void*     agbvk_map_win(AgbVkCtx*);         // WinState
+void*     agbvk_map_fx(AgbVkCtx*);          // FxRegs
+void*     agbvk_map_scanline(AgbVkCtx*);    // 160 Scanline records
+int32_t*  agbvk_map_bg_aff(AgbVkCtx*);      // 4*6  ints
+int32_t*  agbvk_map_obj_aff(AgbVkCtx*);     // 32*4 ints
+
+// The whole state of the selected session for the frame being built, in
+// AgbHwState layout (the staging buffer holds one AgbHwState per session).
+// Write it in place, e.g. with gba::snapshot_to, and submit: the submit only
+// flushes it (a no-op on coherent memory) and the GPU copies it into the
+// shader inputs, with no host-side copy. Same rules as the map_* slices: it
+// holds a stale frame, so write every field; valid until the next submit.
+// Reset any AgbSyncCache/AgbFrameSkip that tracks this session afterwards.
+AgbHwState* agbvk_map_state(AgbVkCtx*);
+
 // ---- Dispatch + readback ----
 // Push-constants = {fbW, fbH, mapW, mapH, objCharBase, objMapMode(0=2D,1=1D)}
+// Any fbW x fbH works: the framebuffers start at 240x160 and are reallocated
+// (waiting for the frames in flight) when a submit needs more.
 void agbvk_dispatch_frame(AgbVkCtx*, uint32_t fbW, uint32_t fbH,
     uint32_t mapW, uint32_t mapH,
     uint32_t objCharBase, uint32_t objMapMode);
 
 // Read back FB as RGBA8; pixelCount = fbW * fbH
+// Reads the most recently submitted frame, waiting for it if necessary.
 void agbvk_readback_rgba(AgbVkCtx*, uint32_t* dstRGBA, size_t pixelCount);
 
+// Copy the w x h rectangle at (x, y) of the selected session's framebuffer
+// (most recent frame, waiting for it if necessary) to dst, whose rows are
+// dstStride pixels apart. The part outside the framebuffer is not written.
+void agbvk_readback_rect(AgbVkCtx*, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+    uint32_t* dst, size_t dstStride);
+
+// ---- Reduced output ----
+// An optional output pass after compose_frame.comp: the framebuffers are
+// composed into device memory and only their reduced form is written to the
+// host-visible output buffer, halving (2x box downscale) each axis and/or
+// repacking each pixel. Output of a session is fbW*fbH pixels (fbW/2 x fbH/2
+// when halved), row after row, tightly packed little-endian, then zero-padded
+// to a 4-byte multiple; session s starts at byte s * agbvk_output_frame_bytes.
+// Applies from the next submit; the first call that enables it compiles the
+// pass. While a reduced output is in use, read frames
+// with agbvk_readback_output: the RGBA8 readbacks return the packed bytes
+// as-is and agbvk_acquire_frame returns 0.
+typedef enum AgbVkOutputFormat {
+    AGBVK_OUTPUT_RGBA8,      // 4 bytes per pixel, as composed (default; no pass unless halved)
+    AGBVK_OUTPUT_GRAY8,      // 1 byte: BT.601 luma, (77R + 150G + 29B + 128) >> 8
+    AGBVK_OUTPUT_RGB565,     // 2 bytes: R in bits 11..15, G 5..10, B 0..4
+    AGBVK_OUTPUT_BGR555,     // 2 bytes, GBA order: R in bits 0..4, G 5..9, B 10..14
+} AgbVkOutputFormat;
+
+void   agbvk_set_output(AgbVkCtx*, AgbVkOutputFormat format, int halfSize);
+// Bytes per session of the most recent frame's output (0 before the first submit).
+size_t agbvk_output_frame_bytes(AgbVkCtx*);
+// Copy up to dstBytes of the most recent frame's output (every session, waiting
+// for it if necessary); returns the bytes copied.
+size_t agbvk_readback_output(AgbVkCtx*, void* dst, size_t dstBytes);
+
+// ---- Frame info ----
+// An optional pass after compose that hashes each session's RGBA8 framebuffer
+// and finds the pixels that changed since that session's previous frame, so
+// callers can skip or narrow readbacks. Only 32 bytes per session come back.
+// While enabled, frames are composed into device memory and forwarded to the
+// output buffer by the pass, so every readback keeps working. Applies from
+// the next submit; the first call that enables it compiles the pass.
+typedef struct AgbVkFrameInfo {
+    uint64_t hash;            // of the fbW*fbH RGBA8 pixels; equal frames hash equal
+    uint32_t changedPixels;   // pixels that differ from the previous frame
+    uint32_t minX, minY;      // inclusive bounding box of the changed pixels
+    uint32_t maxX, maxY;      // (all 0 when changedPixels == 0)
+} AgbVkFrameInfo;
+
+void agbvk_set_frame_info(AgbVkCtx*, int enabled);
+// Info of `session` in a finished frame. A session's first frame after the
+// pass is enabled or the framebuffer size changes counts as entirely changed.
+// 1 = written, 0 = still executing, -1 = unknown ticket, slot already reused,
+// or no info for that session in that frame (pass off or session inactive).
+int  agbvk_frame_info(AgbVkCtx*, uint64_t ticket, uint32_t session, AgbVkFrameInfo* out);
+
+// ---- Upscaled output ----
+// An optional second stage after compose: each session's framebuffer is
+// enlarged by an integer factor in device memory into a separate per-slot
+// buffer sized for it, so scaling costs no CPU pass. Scale2x (EPX) doubles
+// like NEAREST_2X but rounds off staircase edges of pixel art. The 1x RGBA8
+// (or reduced) output and its readbacks are unaffected. Applies from the next
+// submit; the first call that enables it compiles the pass.
+typedef enum AgbVkUpscale {
+    AGBVK_UPSCALE_NONE,
+    AGBVK_UPSCALE_NEAREST_2X,
+    AGBVK_UPSCALE_NEAREST_3X,
+    AGBVK_UPSCALE_NEAREST_4X,
+    AGBVK_UPSCALE_SCALE2X,
+} AgbVkUpscale;
+
+void agbvk_set_upscale(AgbVkCtx*, AgbVkUpscale mode);
+// The most recent frame's upscaled framebuffers in place (waits for the frame
+// if still executing): *w x *h RGBA8 pixels per session, tightly packed,
+// session s at s * *w * *h. Valid like agbvk_acquire_frame and released with
+// agbvk_release_frame. 1 = acquired, 0 = that frame was not upscaled.
+int    agbvk_acquire_upscaled(AgbVkCtx*, const uint32_t** pixels, uint32_t* w, uint32_t* h);
+// Copy up to pixelCount pixels of the same; returns the pixels copied.
+size_t agbvk_readback_upscaled(AgbVkCtx*, uint32_t* dst, size_t pixelCount);
+
+// ---- Pipelined dispatch ----
+// agbvk_submit_frame queues the frame built by the preceding uploads and
+// returns at once with a ticket (> 0). Uploads for the next frame may start
+// immediately; they block only when all framesInFlight slots are still busy.
+// A ticket's framebuffer stays readable until framesInFlight more frames have
+// been submitted. agbvk_dispatch_frame is submit + wait.
+// The compose pass is recorded once per distinct push-constant tuple and
+// reused, so steady-state frames with unchanged inputs only resubmit it.
+// Each frame runs a compose pipeline specialized for the scene's features
+// (enabled/affine BGs, OBJs, windows, blend mode, dimensions). Variants are
+// compiled in the background; until one is ready the general shader is used,
+// with identical output.
+uint64_t agbvk_submit_frame(AgbVkCtx*, uint32_t fbW, uint32_t fbH,
+    uint32_t mapW, uint32_t mapH,
+    uint32_t objCharBase, uint32_t objMapMode);
+void agbvk_wait_frame(AgbVkCtx*, uint64_t ticket);
+// 1 = copied, 0 = still executing, -1 = unknown ticket or slot already reused
+int  agbvk_try_readback(AgbVkCtx*, uint64_t ticket, uint32_t* dstRGBA, size_t pixelCount);
+
+// ---- Zero-copy readback ----
+// The framebuffers of the most recently submitted frame, in place in its
+// slot's mapped output buffer (waits for the frame if still executing):
+// *pixels is session 0, rows are *stride pixels apart, and further sessions
+// follow at agbvk_session_offset(s). Valid until the slot is reused, i.e.
+// framesInFlight submits later; a submit that reuses a still-acquired slot is
+// reported once on stderr. 1 = acquired, 0 = nothing submitted yet.
+int  agbvk_acquire_frame(AgbVkCtx*, const uint32_t** pixels, size_t* stride);
+void agbvk_release_frame(AgbVkCtx*);
+
+// Imported output memory (AgbVkConfig::outputMemory): each buffer must start
+// and end on minImportedHostPointerAlignment (the page size in practice) and
+// hold every session's framebuffer. Ticket t is composed into buffer
+// (t - 1) % framesInFlight. Without the extension, or if a buffer is refused,
+// the context falls back to its own memory: 1 = every slot imported, else 0.
+// A later frame too large for a buffer also moves its slot to own memory.
+int  agbvk_output_imported(AgbVkCtx*);
+
+// ---- GPU timing ----
+// Device time of a finished frame, from the start of its submit (input
+// copies and prepasses included) to the end of its compose pass (and of the
+// frame info and output passes, if any), in ns.
+// 1 = written, 0 = still executing, -1 = unknown ticket, slot already reused
+// or no timestamp support on the compute queue.
+int  agbvk_gpu_time_ns(AgbVkCtx*, uint64_t ticket, uint64_t* ns);
+
+// ---- Memory types ----
+// Each buffer role gets its own memory-type choice: readback targets prefer
+// HOST_CACHED (fast CPU reads), upload targets prefer DEVICE_LOCAL |
+// HOST_VISIBLE (ReBAR) and fall back to plain host-visible memory, and
+// shader-only buffers prefer DEVICE_LOCAL. Non-coherent choices are flushed
+// and invalidated as needed.
+typedef enum AgbVkMemoryRole {
+    AGBVK_MEMORY_SHADER,     // state buffer, prepass outputs
+    AGBVK_MEMORY_UPLOAD,     // per-frame staging and layer maps
+    AGBVK_MEMORY_READBACK,   // output framebuffers
+    AGBVK_MEMORY_ROLE_COUNT
+} AgbVkMemoryRole;
+
+typedef struct AgbVkMemoryInfo {
+    uint32_t typeIndex;      // into VkPhysicalDeviceMemoryProperties::memoryTypes
+    uint32_t heapIndex;
+    uint32_t propertyFlags;  // VkMemoryPropertyFlags of the type
+    uint64_t heapSize;       // bytes
+} AgbVkMemoryInfo;
+
+// Memory type the policy picked for `role`: 1 = written, 0 = unknown role or
+// nothing allocated for it yet (READBACK while every output buffer is
+// imported).
+int agbvk_memory_info(AgbVkCtx*, AgbVkMemoryRole role, AgbVkMemoryInfo* out);
+// Memory type of the imported output buffers (AgbVkConfig::outputMemory),
+// which the caller's memory decides: 1 = written, 0 = nothing imported.
+int agbvk_imported_memory_info(AgbVkCtx*, AgbVkMemoryInfo* out);
+
+// ---- Sessions ----
+// A context holds `sessions` independent screens that share one device,
+// pipeline and set of buffers (each session is a layer of every input and of
+// the output). upload_* / map_* calls write the selected session (0 by
+// default); every submit composes all active sessions in a single dispatch.
+// Session framebuffers follow one another in the readback, session s starting
+// at pixel agbvk_session_offset(s). Inactive sessions are skipped and their
+// framebuffer contents are undefined until they are composed again.
+uint32_t agbvk_session_count(AgbVkCtx*);
+void     agbvk_select_session(AgbVkCtx*, uint32_t session);
+void     agbvk_set_session_active(AgbVkCtx*, uint32_t session, int active);   // all active initially
+size_t   agbvk_session_offset(AgbVkCtx*, uint32_t session);                   // in pixels, at the latest fbW*fbH
+// Like agbvk_readback_rgba, for one session of the most recent frame.
+void     agbvk_readback_session(AgbVkCtx*, uint32_t session, uint32_t* dstRGBA, size_t pixelCount);
+
+// ---- Batch rendering ----
+// Compose `n` independent states and write their framebuffers back to back to
+// outRGBA (n * fbW * fbH pixels). States are laid out as layers of large
+// buffers and composed by one z-dispatch per chunk of up to 64, with a single
+// submit and wait each. Uses the push constants of the latest submit (the
+// 240x160 demo defaults before the first one). Independent of, and does not
+// disturb, the state built by the upload_* calls.
+void agbvk_render_batch(AgbVkCtx*, const AgbHwState* states, size_t n, uint32_t* outRGBA);
+
 #if defined(__cplusplus)
 } // extern "C"
 #endif